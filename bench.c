@@ -0,0 +1,153 @@
+/**
+ * @file bench.c
+ *
+ * @brief This file contains the SPI throughput benchmark
+ *
+ * The benchmark runs on a connected ISP target. For every programming clock
+ * option (from slowest to fastest) it reads a block of target flash several
+ * times, checks the data against a read with the slowest clock and measures
+ * the throughput. After a failed option the target is reconnected with the
+ * clock option of the script, so it is in sync for the following steps.
+ * Then it times a page write with RDY/BSY polling (a page of 0xff does not
+ * change the target flash as page writes don't erase). Results are reported
+ * on the USART, on MCUs without report output the number of working clock
+ * options is blinked on the green LED.
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include <inttypes.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "clock.h"
+#include "hal.h"
+#include "isp.h"
+#include "device.h"
+#include "uart.h"
+#include "bench.h"
+
+#ifdef BENCHMARK
+
+/**
+ * @brief Programming clock options ordered from slowest to fastest
+ */
+static const uint8_t bench_sckoptions[BENCH_SCKOPTIONS] PROGMEM = {
+    0x03, // fosc/128
+    0x02, // fosc/64
+    0x07, // fosc/64 (SPI2X)
+    0x06, // fosc/32
+    0x01, // fosc/16
+    0x05, // fosc/8
+    0x00, // fosc/4
+    0x04  // fosc/2
+};
+
+/**
+ * @brief Read block of target flash into given buffer and wait for it
+ * @param buffer Buffer with ISP_PAGEBUFFER_SIZE bytes
+ */
+static void bench_read(uint8_t * buffer) {
+    isp_readPage(ISP_MEMTYPE_FLASH, 0, buffer, ISP_PAGEBUFFER_SIZE);
+    isp_waitTransfer();
+}
+
+/**
+ * @brief Run SPI throughput benchmark on connected ISP target
+ * @retval 0 No programming clock option worked or target lost
+ * @retval 1 Benchmark done
+ */
+uint8_t bench_run() {
+
+    uint8_t reference[ISP_PAGEBUFFER_SIZE];
+    uint8_t buffer[ISP_PAGEBUFFER_SIZE];
+    uint8_t sckoption = isp_getSCK();
+    uint8_t working = 0;
+    uint8_t i;
+
+    isp_setSCK(ISP_SCKOPTION_SLOWEST);
+    bench_read(reference);
+
+#ifdef USART_UDR
+    uart_init();
+    uart_puts_P(PSTR("\r\nSPI benchmark\r\n"));
+#endif
+
+    for (i = 0; i < BENCH_SCKOPTIONS; i++) {
+
+        uint8_t option = pgm_read_byte(&bench_sckoptions[i]);
+        uint8_t ok = 1;
+        uint8_t run;
+
+        isp_setSCK(option);
+
+        uint16_t ticks = clock_getTicks();
+        for (run = 0; run < BENCH_RUNS; run++) {
+            bench_read(buffer);
+            if (memcmp(reference, buffer, sizeof (buffer)) != 0) ok = 0;
+        }
+        ticks = clock_getTicks() - ticks;
+        if (ticks == 0) ticks = 1;
+
+        working += ok;
+
+#ifdef USART_UDR
+        // 4 SPI bytes per read instruction
+        uint32_t bytes = (uint32_t) BENCH_RUNS * ISP_PAGEBUFFER_SIZE * 4;
+
+        uart_puts_P(PSTR("SCK option "));
+        uart_putDecimal(option);
+        uart_puts_P(PSTR(": "));
+        uart_putDecimal(bytes * (1000000UL / CLOCK_TICKER_FAST_US) / ticks);
+        uart_puts_P(ok ? PSTR(" B/s ok\r\n") : PSTR(" B/s FAIL\r\n"));
+#endif
+
+        // a too fast clock may shift the target out of byte sync: reset it
+        // and enter programming mode again before next option is tried
+        if (!ok && !isp_connect(sckoption)) return 0;
+    }
+
+    isp_setSCK(sckoption);
+
+    // time a page write of 0xff
+    uint16_t pagesize = device_current.flashpagesize;
+    if ((pagesize == 0) || (pagesize > ISP_PAGEBUFFER_SIZE)) pagesize = ISP_PAGEBUFFER_SIZE;
+    memset(buffer, 0xff, pagesize);
+
+    uint16_t ticks = clock_getTicks();
+    isp_loadPage(ISP_MEMTYPE_FLASH, 0, buffer, pagesize);
+    isp_commitPage(ISP_MEMTYPE_FLASH, 0);
+    ticks = clock_getTicks() - ticks;
+
+#ifdef USART_UDR
+    uart_puts_P(PSTR("Page load and write: "));
+    uart_putDecimal((uint32_t) ticks * CLOCK_TICKER_FAST_US);
+    uart_puts_P((device_current.flags & DEVICE_FLAG_POLLING) ? PSTR(" us (RDY/BSY polling)\r\n") : PSTR(" us (fixed delay)\r\n"));
+#else
+    while (working--) {
+        hal_setLEDgreen(0);
+        clock_delaySlow(CLOCK_TICKER_SLOW_250MS);
+        hal_setLEDgreen(1);
+        clock_delaySlow(CLOCK_TICKER_SLOW_250MS);
+    }
+    working = 1;
+#endif
+
+    return working > 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file bench.h
+ *
+ * @brief This file contains definitions for the SPI throughput benchmark
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef _BENCH_
+#define _BENCH_
+
+#define BENCH_RUNS 4            ///< Page reads per programming clock option
+#define BENCH_SCKOPTIONS 8      ///< Number of programming clock options
+
+uint8_t bench_run();
+
+#endif
@@ -30,8 +30,12 @@
 /**
  * @brief This variable ticks slow generated with timer interrupt
  */
-uint8_t slowticker;
+volatile uint8_t slowticker;
 
+/**
+ * @brief Task to run while waiting in delay functions
+ */
+static clock_task_t clock_idletask = 0;
 
 /**
  * @brief Initialize timer
@@ -49,6 +53,25 @@ void clock_init() {
 }
 
 
+/**
+ * @brief Set task which is called repeatedly while waiting in delay functions
+ *
+ * The task has to return quickly (a few microseconds), as it delays the end
+ * of the wait by its runtime.
+ *
+ * @param task Idle task or 0 to disable
+ */
+void clock_setIdleTask(clock_task_t task) {
+    clock_idletask = task;
+}
+
+/**
+ * @brief Give idle task a chance to run
+ */
+void clock_yield() {
+    if (clock_idletask) clock_idletask();
+}
+
 /**
  * @brief Get current value of slow-ticker
  * @return Current slow-ticker
@@ -73,6 +96,7 @@ uint8_t clock_getTickerSlowDiff(uint8_t ticker) {
 void clock_delaySlow(uint8_t ticks) {
     uint8_t ticker = clock_getTickerSlow();
     while (clock_getTickerSlowDiff(ticker) < ticks) {
+        clock_yield();
     };
 }
 
@@ -93,6 +117,23 @@ uint8_t clock_getTickerFastDiff(uint8_t ticker) {
     return (uint8_t) (clock_getTickerFast() - ticker);
 }
 
+/**
+ * @brief Get current value of 16 bit ticker (slow-ticker and fast-ticker
+ *        combined, resolution of fast-ticker)
+ * @return Current 16 bit ticker
+ */
+uint16_t clock_getTicks() {
+    uint8_t slow;
+    uint8_t fast;
+
+    do {
+        slow = slowticker;
+        fast = TCNT0;
+    } while (slow != slowticker);
+
+    return ((uint16_t) slow << 8) | fast;
+}
+
 /**
  * @brief Wait given ticks (reference is fast-ticker)
  * @param ticks Ticks to wait
@@ -100,6 +141,7 @@ uint8_t clock_getTickerFastDiff(uint8_t ticker) {
 void clock_delayFast(uint8_t ticks) {
     uint8_t ticker = clock_getTickerFast();
     while (clock_getTickerFastDiff(ticker) < ticks) {
+        clock_yield();
     };
 }
 
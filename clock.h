@@ -36,13 +36,22 @@
 #define CLOCK_TICKER_FAST_10MS 78   ///< 10ms fast ticks
 #define CLOCK_TICKER_FAST_20MS 156  ///< 20ms fast ticks
 #define CLOCK_TICKER_FAST_25MS 195  ///< 25ms fast ticks
+#define CLOCK_TICKER_FAST_US 128    ///< Microseconds per fast tick
+
+/**
+ * @brief Idle task called repeatedly while waiting in delay functions
+ */
+typedef void (*clock_task_t)(void);
 
 void clock_init();
+void clock_setIdleTask(clock_task_t task);
+void clock_yield();
 uint8_t clock_getTickerSlow();
 uint8_t clock_getTickerSlowDiff(uint8_t ticker);
 void clock_delaySlow(uint8_t ticks);
 uint8_t clock_getTickerFast();
 uint8_t clock_getTickerFastDiff(uint8_t ticker);
 void clock_delayFast(uint8_t ticks);
+uint16_t clock_getTicks();
 
 #endif
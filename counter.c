@@ -29,6 +29,11 @@
  */
 #define COUNTER_REDUNCY 3
 
+/**
+ * @brief EEPROM address of serial number storage (behind programming counter)
+ */
+#define COUNTER_SERIAL_ADDRESS (COUNTER_REDUNCY * 2 * sizeof (uint16_t))
+
 /**
  * @brief Read current programming counter value from EEPROM
  * @return Programming counter value
@@ -85,3 +90,44 @@ void counter_decrement(uint16_t startvalue) {
 
     counter_write(counter);
 }
+
+/**
+ * @brief Read next serial number from EEPROM
+ * @return Next serial number or 0xffffffff if none is stored
+ */
+uint32_t counter_readSerial() {
+
+    uint32_t serial = 0xffffffff;
+    uint8_t i;
+    uint32_t * eeadr = (uint32_t *) COUNTER_SERIAL_ADDRESS;
+
+    for (i = 0; i < COUNTER_REDUNCY; i++) {
+
+        uint32_t eeval = eeprom_read_dword(eeadr++);
+
+        if (eeval == ~eeprom_read_dword(eeadr++)) {
+            // valid value, highest one wins so a serial is never used twice
+
+            if ((serial == 0xffffffff) || (eeval > serial)) serial = eeval;
+        }
+    }
+
+    return serial;
+}
+
+/**
+ * @brief Write next serial number to EEPROM
+ * @param serial Next serial number
+ */
+void counter_writeSerial(uint32_t serial) {
+
+    uint8_t i;
+    uint32_t * eeadr = (uint32_t *) COUNTER_SERIAL_ADDRESS;
+
+    for (i = 0; i < COUNTER_REDUNCY; i++) {
+
+        eeprom_write_dword(eeadr++, serial);
+        eeprom_write_dword(eeadr++, ~serial);
+    }
+
+}
@@ -27,6 +27,8 @@
 uint16_t counter_read();
 void counter_write(uint16_t counter);
 void counter_decrement(uint16_t startvalue);
+uint32_t counter_readSerial();
+void counter_writeSerial(uint32_t serial);
 
 #endif 
 
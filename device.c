@@ -0,0 +1,105 @@
+/**
+ * @file device.c
+ *
+ * @brief This file contains the target device table
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "clock.h"
+#include "isp.h"
+#include "device.h"
+
+/**
+ * @brief Convert microseconds into fast ticks (rounded up, plus one tick for
+ *        the unknown phase of the ticker when starting to wait)
+ */
+#define DEVICE_US(us) ((us) / 128 + 2)
+
+/**
+ * @brief Known devices
+ */
+static const device_t device_table[] PROGMEM = {
+    // signature          flash eeprom  tWD_FLASH        tWD_EEPROM        tWD_ERASE         tWD_FUSE          flags
+    {{0x1E, 0x90, 0x07},  32,   4,      DEVICE_US(4500), DEVICE_US(4000),  DEVICE_US(4000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATtiny13
+    {{0x1E, 0x91, 0x0A},  32,   4,      DEVICE_US(4500), DEVICE_US(4000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATtiny2313
+    {{0x1E, 0x91, 0x08},  32,   4,      DEVICE_US(4500), DEVICE_US(4000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATtiny25
+    {{0x1E, 0x92, 0x06},  64,   4,      DEVICE_US(4500), DEVICE_US(4000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATtiny45
+    {{0x1E, 0x93, 0x0B},  64,   4,      DEVICE_US(4500), DEVICE_US(4000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATtiny85
+    {{0x1E, 0x93, 0x07},  64,   1,      DEVICE_US(4500), DEVICE_US(9000),  DEVICE_US(9000),  DEVICE_US(4500),  0},                   // ATmega8
+    {{0x1E, 0x92, 0x05},  64,   4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega48
+    {{0x1E, 0x92, 0x0A},  64,   4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega48P
+    {{0x1E, 0x93, 0x0A},  64,   4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega88
+    {{0x1E, 0x93, 0x0F},  64,   4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega88P
+    {{0x1E, 0x94, 0x06},  128,  4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega168
+    {{0x1E, 0x94, 0x0B},  128,  4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega168P
+    {{0x1E, 0x95, 0x14},  128,  4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega328
+    {{0x1E, 0x95, 0x0F},  128,  4,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega328P
+    {{0x1E, 0x94, 0x03},  128,  1,      DEVICE_US(4500), DEVICE_US(9000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega16
+    {{0x1E, 0x95, 0x02},  128,  1,      DEVICE_US(4500), DEVICE_US(9000),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega32
+    {{0x1E, 0x96, 0x0A},  256,  8,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega644P
+    {{0x1E, 0x97, 0x05},  256,  8,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega1284P
+    {{0x1E, 0x98, 0x01},  256,  8,      DEVICE_US(4500), DEVICE_US(3600),  DEVICE_US(9000),  DEVICE_US(4500),  DEVICE_FLAG_POLLING}, // ATmega2560
+};
+
+/**
+ * @brief Parameters of currently connected device
+ */
+device_t device_current;
+
+/**
+ * @brief Set parameters of unknown device (script page sizes, worst case
+ *        delays, no additional erase and fuse delays)
+ */
+void device_reset() {
+    memset(&device_current, 0, sizeof (device_current));
+    device_current.delayflash = ISP_DELAY_FLASH;
+    device_current.delayeeprom = ISP_DELAY_EEPROM;
+}
+
+/**
+ * @brief Read signature of connected ISP target and look up its parameters
+ * @retval 0 Device is unknown, default parameters are used
+ * @retval 1 Device found in table
+ */
+uint8_t device_identify() {
+
+    uint8_t signature[3];
+    uint8_t i;
+
+    device_reset();
+
+    for (i = 0; i < sizeof (signature); i++) {
+        uint8_t data[4] = {ISP_CMD_READ_SIGNATURE_BYTE, 0x00, i, 0x00};
+        isp_transmit(data, sizeof (data));
+        signature[i] = data[3];
+    }
+
+    for (i = 0; i < sizeof (device_table) / sizeof (device_table[0]); i++) {
+        if (memcmp_P(signature, device_table[i].signature, sizeof (signature)) == 0) {
+            memcpy_P(&device_current, &device_table[i], sizeof (device_current));
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file device.h
+ *
+ * @brief This file contains definitions for the target device table
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#define DEVICE_FLAG_POLLING 0x01    ///< Device supports RDY/BSY polling
+
+/**
+ * @brief Programming parameters of a target device
+ *
+ * Delays are given in fast ticks. A page size of 0 means unknown, so the
+ * page size given by the script is used.
+ */
+typedef struct {
+    uint8_t signature[3];   ///< Signature bytes
+    uint16_t flashpagesize; ///< Flash page size in bytes
+    uint8_t eeprompagesize; ///< EEPROM page size in bytes (1: byte mode only)
+    uint8_t delayflash;     ///< tWD_FLASH
+    uint8_t delayeeprom;    ///< tWD_EEPROM
+    uint8_t delayerase;     ///< tWD_ERASE
+    uint8_t delayfuse;      ///< tWD_FUSE
+    uint8_t flags;          ///< DEVICE_FLAG_* bits
+} device_t;
+
+extern device_t device_current;
+
+void device_reset();
+uint8_t device_identify();
+
+#endif
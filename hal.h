@@ -44,6 +44,8 @@
 #define ISP_MISO  PB4
 #define ISP_SCK   PB5
 
+#define ISP_PAGEBUFFER_SIZE 64
+
 // ******************************** ATmega128P ***********************************
 #elif defined (__AVR_ATmega1284P__)
 
@@ -53,6 +55,8 @@
 #define hal_getSwitch() ((PIND & (1 << PD3)) == 0)
 #define hal_setLEDred(x) PORTC = (PORTC & ~(1 << PC3)) | ((!x) << PC3)
 #define hal_setLEDgreen(x) PORTD = (PORTD & ~(1 << PD4)) | ((!x) << PD4)
+// optional target VCC sense input for AUTOSTART, otherwise the target is probed
+//#define hal_getTargetSense() ((PINA & (1 << PA0)) != 0)
 
 #define flash_readbyte(x) pgm_read_byte_far(x)
 
@@ -64,14 +68,59 @@
 #define ISP_MISO  PB6
 #define ISP_SCK   PB7
 
+#define ISP_PAGEBUFFER_SIZE 256
+
 #define TCCR0 TCCR0B
 #define TIMSK TIMSK0
 
+// USART0: UPDI line on RXD0 and via 4k7 resistor on TXD0, report output
+#define USART_UDR   UDR0
+#define USART_UCSRA UCSR0A
+#define USART_UCSRB UCSR0B
+#define USART_UCSRC UCSR0C
+#define USART_UBRR  UBRR0
+#define USART_UCSRC_8N1 ((1 << UCSZ01) | (1 << UCSZ00))
+#define USART_UCSRC_8E2 ((1 << UPM01) | (1 << USBS0) | (1 << UCSZ01) | (1 << UCSZ00))
+#define USART_U2X   U2X0
+#define USART_RXEN  RXEN0
+#define USART_TXEN  TXEN0
+#define USART_RXC   RXC0
+#define USART_UDRE  UDRE0
+#define USART_FE    FE0
+#define USART_UPE   UPE0
+#define USART_OUT   PORTD
+#define USART_DDR   DDRD
+#define USART_TXD   PD1
+#define USART_UCSRC_MSPIM ((1 << UMSEL01) | (1 << UMSEL00))
+#define USART_XCK_DDR DDRB
+#define USART_XCK   PB0
+
+// optional external NOR flash (NORSTORE) on USART0 in SPI master mode
+#define NOR_CS_OUT  PORTB
+#define NOR_CS_DDR  DDRB
+#define NOR_CS      PB1
+
 // ****************************** unknown device *********************************
 #else 
   #error "MCU not supported by HAL"
 #endif
 
+// ****************************** NOR image store ********************************
+#ifdef NORSTORE
+#include "nor.h"
+
+#undef DEFINE_DATAPOINTER
+#undef flash_readbyte
+#define DEFINE_DATAPOINTER uint32_t scriptdata_p = 0
+#define flash_readbyte(x) nor_readbyte(x)
+#define SCRIPT_DATAEND NOR_SIZE
+
+#else
+
+#define SCRIPT_DATAEND (FLASHEND + 1)
+
+#endif
+
 
 /**
  * @brief Macro to access strings defined in PROGMEM above 64kB
@@ -22,10 +22,195 @@
  */
 #include <inttypes.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "clock.h"
 #include "hal.h"
 #include "isp.h"
+#include "device.h"
+
+/**
+ * @brief Check echo of ISP instructions
+ */
+static uint8_t isp_synccheck = 0;
+
+/**
+ * @brief Set if echo check of ISP instructions detected loss of sync
+ */
+static volatile uint8_t isp_syncerror = 0;
+
+/**
+ * @brief Flash segment whose verification waits for its page to be written
+ */
+typedef struct {
+    uint32_t mempointer;    ///< Pointer to data in script memory
+    uint32_t address;       ///< Target address
+    uint16_t length;        ///< Length of segment
+} isp_segment_t;
+
+static uint8_t isp_flashpending = 0;    ///< Last flash page is loaded, but not written yet
+static uint32_t isp_flashpendingpage;   ///< Start address of pending flash page
+static uint16_t isp_flashpendingsize;   ///< Page size of pending flash page
+static isp_segment_t isp_deferred[ISP_DEFERRED_SEGMENTS]; ///< Segments in pending page
+static uint8_t isp_deferredcount = 0;   ///< Number of deferred segments
+
+/**
+ * @brief Enable or disable echo check of ISP instructions
+ * @param enable 1 to enable check, 0 to disable it
+ */
+void isp_setSyncCheck(uint8_t enable) {
+    isp_synccheck = enable;
+}
+
+/**
+ * @brief Get sync state of ISP target
+ * @retval 0 Target is in sync
+ * @retval 1 Echo check detected loss of sync since connect (cleared on disconnect)
+ */
+uint8_t isp_getSyncError() {
+    return isp_syncerror;
+}
+
+#ifdef ISP_ASYNC
+
+/**
+ * @brief Set while interrupt driven transfer is running
+ */
+static volatile uint8_t isp_queuebusy = 0;
+
+static uint8_t isp_queueasync = 0;          ///< Use interrupt driven transfers
+static uint8_t isp_queueinstruction[4];     ///< Instruction currently transferred
+static uint8_t isp_queuepos;                ///< Position of byte currently transferred
+static uint8_t isp_queuenext;               ///< Next byte to send (prepared by previous interrupt)
+static uint8_t isp_queuepending;            ///< There is a next byte to send
+static uint8_t isp_queuecmd;                ///< Instruction byte 1 (without high byte flag)
+static uint8_t isp_queueflash;              ///< Flash addressing (word address and high byte flag)
+static uint8_t isp_queueread;               ///< Store response bytes into buffer
+static uint8_t * isp_queuedata;             ///< Next data byte to load
+static uint8_t * isp_queuebuffer;           ///< Next buffer position to store read data to
+static uint16_t isp_queueremaining;         ///< Number of instructions not built yet
+static uint16_t isp_queueaddress;           ///< Target address of next instruction (word address for flash)
+static uint8_t isp_queuehighbyte;           ///< Next flash byte is high byte
+
+/**
+ * @brief Build next instruction of interrupt driven transfer and advance address
+ */
+static inline void isp_queueBuild() {
+    isp_queueinstruction[0] = isp_queuecmd | (isp_queuehighbyte << 3);
+    isp_queueinstruction[1] = isp_queueaddress >> 8;
+    isp_queueinstruction[2] = isp_queueaddress;
+    isp_queueinstruction[3] = isp_queueread ? 0 : *isp_queuedata++;
+
+    if (isp_queueflash) {
+        isp_queueaddress += isp_queuehighbyte;
+        isp_queuehighbyte ^= 1;
+    } else {
+        isp_queueaddress++;
+    }
+}
+
+/**
+ * @brief Start interrupt driven transfer of one instruction per buffer byte
+ * @param cmd Instruction byte 1
+ * @param flash Use flash addressing
+ * @param read Store response bytes into buffer
+ * @param address Target address of first byte (word address for flash)
+ * @param highbyte First byte is high byte of flash word
+ * @param buffer Pointer to data to load or to buffer to store read data
+ * @param length Length of data block
+ */
+static void isp_queueStart(uint8_t cmd, uint8_t flash, uint8_t read, uint16_t address, uint8_t highbyte, uint8_t * buffer, uint16_t length) {
+
+    isp_waitTransfer();
+    if (length == 0) return;
+
+    isp_queuecmd = cmd;
+    isp_queueflash = flash;
+    isp_queueread = read;
+    isp_queueaddress = address;
+    isp_queuehighbyte = highbyte;
+    isp_queuedata = buffer;
+    isp_queuebuffer = buffer;
+    isp_queueremaining = length - 1;
+
+    isp_queueBuild();
+    isp_queuepos = 0;
+    isp_queuenext = isp_queueinstruction[1];
+    isp_queuepending = 1;
+    isp_queuebusy = 1;
+
+    SPCR |= (1 << SPIE);
+    SPDR = isp_queueinstruction[0];
+}
+
+/**
+ * @brief Wait until interrupt driven transfer is finished
+ */
+void isp_waitTransfer() {
+    while (isp_queuebusy) clock_yield();
+}
+
+/**
+ * @brief SPI transfer complete interrupt: send next byte of queued transfer
+ *
+ * The next byte is prepared by the previous interrupt and sent first, so the
+ * bus only waits for the interrupt prologue. The byte after it is prepared
+ * while this one is shifted.
+ */
+ISR(SPI_STC_vect) {
+
+    if (isp_queuepending) SPDR = isp_queuenext;
+
+    // receive direction is double buffered: still holds completed byte
+    uint8_t data = SPDR;
+    uint8_t pos = isp_queuepos;
+
+    if (pos == 3) {
+
+        if (isp_queueread) *isp_queuebuffer++ = data;
+
+        if (!isp_queuepending) {
+            SPCR &= ~(1 << SPIE);
+            isp_queuebusy = 0;
+            return;
+        }
+
+        pos = 0;
+
+    } else {
+
+        if ((pos == 2) && isp_synccheck && (data != isp_queueinstruction[1])) isp_syncerror = 1;
+        pos++;
+    }
+
+    isp_queuepos = pos;
+
+    // prepare byte following the one in flight
+    if (pos < 3) {
+        isp_queuenext = isp_queueinstruction[pos + 1];
+    } else if (isp_queueremaining) {
+        // last byte of instruction is in flight: the array may be reused
+        isp_queueremaining--;
+        isp_queueBuild();
+        isp_queuenext = isp_queueinstruction[0];
+    } else {
+        isp_queuepending = 0;
+    }
+}
+
+#else
+
+#define isp_queueasync 0
+#define isp_queueStart(cmd, flash, read, address, highbyte, buffer, length)
+
+/**
+ * @brief Wait until interrupt driven transfer is finished (all transfers are polled)
+ */
+void isp_waitTransfer() {
+}
+
+#endif
 
 /**
  * @brief Transmit given byte over SPI
@@ -33,12 +218,80 @@
  * @return Byte read from SPI during transfer
  */
 uint8_t ispTransmit_hw(uint8_t send_byte) {
+    isp_waitTransfer();
+
     SPDR = send_byte;
 
     while (!(SPSR & (1 << SPIF)));
     return SPDR;
 }
 
+/**
+ * @brief Programming clock option currently used
+ */
+static uint8_t isp_sckoption;
+
+/**
+ * @brief Set programming clock and enable SPI
+ * @param sckoption Programming clock option (bit 2: SPI2X, bit 1..0: SPR)
+ */
+void isp_setSCK(uint8_t sckoption) {
+
+    isp_waitTransfer();
+
+    isp_sckoption = sckoption;
+    SPSR = (sckoption >> 2) & 1;
+    SPCR = (1 << SPE) | (1 << MSTR) | (sckoption & 0x03);
+
+#ifdef ISP_ASYNC
+    // from fosc/32 on, a byte takes >= 256 cycles: the interrupt prologue
+    // delays every byte, compare with polled transfers using BENCHMARK
+    isp_queueasync = (sckoption & 0x02) != 0;
+#endif
+}
+
+/**
+ * @brief Get programming clock option currently used
+ * @return Programming clock option
+ */
+uint8_t isp_getSCK() {
+    return isp_sckoption;
+}
+
+/**
+ * @brief Pulse reset of ISP target and try to enter programming mode once
+ * @param sckoption Programming clock option
+ * @retval 0 Target didn't answer
+ * @retval 1 Target is in sync
+ */
+static uint8_t isp_enterProgramming(uint8_t sckoption) {
+
+    /* positive reset pulse > 2 SCK (target) */
+    clock_delayFast(CLOCK_TICKER_FAST_5MS);
+    ISP_OUT |= (1 << ISP_RST); /* RST high */
+    clock_delayFast(CLOCK_TICKER_FAST_5MS);
+    ISP_OUT &= ~(1 << ISP_RST); /* RST low */
+
+    // wait minimum 20ms
+    clock_delayFast(CLOCK_TICKER_FAST_25MS);
+
+    // set spi clock and enable spi
+    isp_setSCK(sckoption);
+
+    uint8_t data[4] = {0xAC, 0x53, 0x00, 0x00};
+    isp_transmit(data, sizeof (data));
+
+    if (data[2] == 0x53) {
+        // we are in sync
+        return 1;
+    }
+
+    // disable spi
+    SPCR = 0;
+
+    return 0;
+}
+
 /**
  * @brief Connect to ISP target
  * @param sckoption Programming clock option
@@ -56,38 +309,43 @@ uint8_t isp_connect(uint8_t sckoption) {
     ISP_OUT &= ~(1 << ISP_SCK); /* SCK low */
 
 
+    isp_syncerror = 0;
+    isp_flashpending = 0;
+    isp_deferredcount = 0;
+
     uint8_t retries = 32;
     do {
-        /* positive reset pulse > 2 SCK (target) */
-        clock_delayFast(CLOCK_TICKER_FAST_5MS);
-        ISP_OUT |= (1 << ISP_RST); /* RST high */
-        clock_delayFast(CLOCK_TICKER_FAST_5MS);
-        ISP_OUT &= ~(1 << ISP_RST); /* RST low */
-
-        // wait minimum 20ms
-        clock_delayFast(CLOCK_TICKER_FAST_25MS);
-
-        // set spi clock and enable spi
-        SPSR = (sckoption >> 2) & 1;
-        SPCR = (1 << SPE) | (1 << MSTR) | (sckoption & 0x03);
-
-        uint8_t data[4] = {0xAC, 0x53, 0x00, 0x00};
-        isp_transmit(data, sizeof (data));
-
-        if (data[2] == 0x53) {
-            // we are in sync
+        if (isp_enterProgramming(sckoption)) {
+            device_identify();
             return 1;
         }
 
-        // disable spi
-        SPCR = 0;
-
         retries--;
     } while (retries > 0);
 
     return 0;
 }
 
+/**
+ * @brief Check if an ISP target is connected by a single sync attempt
+ *
+ * Uses the slowest programming clock and releases the ISP pins afterwards.
+ *
+ * @retval 0 No target answered
+ * @retval 1 Target is present
+ */
+uint8_t isp_probe() {
+
+    ISP_DDR |= (1 << ISP_RST) | (1 << ISP_SCK) | (1 << ISP_MOSI);
+    ISP_OUT &= ~((1 << ISP_RST) | (1 << ISP_SCK));
+
+    uint8_t present = isp_enterProgramming(ISP_SCKOPTION_SLOWEST);
+
+    isp_disconnect();
+
+    return present;
+}
+
 /**
  * @brief Disconnect from ISP target
  * @retval 1 Everything okay
@@ -95,6 +353,13 @@ uint8_t isp_connect(uint8_t sckoption) {
  */
 uint8_t isp_disconnect() {
 
+    isp_waitTransfer();
+
+    // a page not flushed yet is dropped, next session starts in sync
+    isp_flashpending = 0;
+    isp_deferredcount = 0;
+    isp_syncerror = 0;
+
     // set all ISP pins inputs
     ISP_DDR &= ~((1 << ISP_RST) | (1 << ISP_SCK) | (1 << ISP_MOSI));
     // switch pullups off
@@ -113,6 +378,8 @@ uint8_t isp_disconnect() {
  */
 void isp_transmit(uint8_t * data, uint8_t len) {
     uint8_t i;
+
+    isp_waitTransfer();
     for (i = 0; i < len; i++) {
         SPDR = data[i];
         while (!(SPSR & (1 << SPIF)));
@@ -121,173 +388,662 @@ void isp_transmit(uint8_t * data, uint8_t len) {
 }
 
 /**
- * @brief Transfer given memory block to ISP target flash
- * @param mempointer Pointer to start of data to transfer
- * @param address Target address
+ * @brief Transmit one 4-byte ISP instruction
+ *
+ * The target echoes instruction byte 2 while receiving byte 3. If sync check
+ * is enabled, a mismatch sets the sync error flag.
+ *
+ * @param cmd Instruction byte 1
+ * @param addrhi Instruction byte 2
+ * @param addrlo Instruction byte 3
+ * @param value Instruction byte 4
+ * @return Byte read from SPI during transfer of last instruction byte
+ */
+static uint8_t isp_instruction(uint8_t cmd, uint8_t addrhi, uint8_t addrlo, uint8_t value) {
+    ispTransmit_hw(cmd);
+    ispTransmit_hw(addrhi);
+    uint8_t echo = ispTransmit_hw(addrlo);
+    value = ispTransmit_hw(value);
+
+    if (isp_synccheck && (echo != addrhi)) isp_syncerror = 1;
+
+    return value;
+}
+
+/**
+ * @brief Load extended address byte for given flash address
+ * @param address Target flash byte address
+ */
+static void isp_loadExtendedAddress(uint32_t address) {
+    isp_instruction(ISP_CMD_LOAD_EXTENDED_ADDRESS_BYTE, 0, address >> 17, 0);
+}
+
+/**
+ * @brief Wait until ISP target finished internal write operation
+ *
+ * If the connected device supports RDY/BSY polling, the given time is used
+ * as timeout only.
+ *
+ * @param ticks Maximum time to wait in fast ticks
+ */
+static void isp_waitReady(uint8_t ticks) {
+
+    if (device_current.flags & DEVICE_FLAG_POLLING) {
+        uint8_t ticker = clock_getTickerFast();
+        while (clock_getTickerFastDiff(ticker) < ticks) {
+            if ((isp_instruction(ISP_CMD_POLL_READY, 0, 0, 0) & 1) == 0) return;
+            clock_yield();
+        }
+    } else {
+        clock_delayFast(ticks);
+    }
+}
+
+/**
+ * @brief Wait for completion of given instruction if it starts a chip
+ *        erase or a fuse/lock bits write on the connected device
+ * @param cmd1 Instruction byte 1
+ * @param cmd2 Instruction byte 2
+ */
+void isp_completeInstruction(uint8_t cmd1, uint8_t cmd2) {
+
+    if (cmd1 != ISP_CMD_WRITE) return;
+
+    switch (cmd2) {
+        case ISP_CMD_WRITE_CHIP_ERASE:
+            isp_waitReady(device_current.delayerase);
+            break;
+        case ISP_CMD_WRITE_LOCK_BITS:
+        case ISP_CMD_WRITE_FUSE_BITS:
+        case ISP_CMD_WRITE_FUSE_HIGH_BITS:
+        case ISP_CMD_WRITE_EXTENDED_FUSE_BITS:
+            isp_waitReady(device_current.delayfuse);
+            break;
+    }
+}
+
+/**
+ * @brief Load given SRAM buffer into page buffer of ISP target
+ *
+ * The block must not cross a page boundary of the target. For flash, the
+ * extended address byte is loaded once per call. With slow programming clock
+ * the transfer runs interrupt driven in background: the buffer must not be
+ * changed before isp_waitTransfer() returns.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
+ * @param address Target address of first byte in buffer
+ * @param buffer Pointer to data to load
  * @param length Length of data block
- * @param pagesize Size of target flash page
  */
-void isp_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+void isp_loadPage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length) {
 
-    uint8_t doflush = 0;
-    uint8_t data[4];
-    uint8_t hiaddress = 0xff;
-    while (length > 0) {
+    uint16_t i = 0;
+
+    if (memtype == ISP_MEMTYPE_FLASH) {
+
+        isp_loadExtendedAddress(address);
+
+        uint16_t wordaddress = address >> 1;
 
-        // load extended address
-        if ((address >> 17) != hiaddress) {
-            hiaddress = address >> 17;
-            data[0] = ISP_CMD_LOAD_EXTENDED_ADDRESS_BYTE;
-            data[1] = 0;
-            data[2] = hiaddress;
-            data[3] = 0;
-            isp_transmit(data, sizeof (data));
+        if (isp_queueasync) {
+            isp_queueStart(ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE, 1, 0, wordaddress, address & 1, buffer, length);
+            return;
         }
 
-        // load byte
-        data[0] = ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE | ((address & 1) << 3);
-        data[1] = address >> 9;
-        data[2] = address >> 1;
-        data[3] = flash_readbyte(mempointer++);
-        isp_transmit(data, sizeof (data));
-        doflush = 1;
+        // odd start address: load high byte first
+        if (address & 1) {
+            isp_instruction(ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE | 0x08, wordaddress >> 8, wordaddress, buffer[i++]);
+            wordaddress++;
+        }
+
+        // load full words
+        while ((uint16_t) (length - i) >= 2) {
+            isp_instruction(ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE, wordaddress >> 8, wordaddress, buffer[i]);
+            isp_instruction(ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE | 0x08, wordaddress >> 8, wordaddress, buffer[i + 1]);
+            wordaddress++;
+            i += 2;
+        }
 
-        if ((((address + 1) % pagesize) == 0) || ((length == 1) && (doflush))) {
-            // flush page
+        // remaining low byte
+        if (i < length) {
+            isp_instruction(ISP_CMD_LOAD_PROGRAM_MEMORY_PAGE_LOW_BYTE, wordaddress >> 8, wordaddress, buffer[i]);
+        }
 
-            data[0] = ISP_CMD_WRITE_PROGRAM_MEMORY_PAGE;
-            data[1] = address >> 9;
-            data[2] = address >> 1;
-            data[3] = 0;
-            isp_transmit(data, sizeof (data));
+    } else {
 
-            clock_delayFast(ISP_DELAY_FLASH);
+        if (isp_queueasync) {
+            isp_queueStart(ISP_CMD_LOAD_EEPROM_MEMORY_PAGE, 0, 0, address, 0, buffer, length);
+            return;
+        }
 
-            doflush = 0;
+        uint16_t eeaddress = address;
+        for (; i < length; i++, eeaddress++) {
+            isp_instruction(ISP_CMD_LOAD_EEPROM_MEMORY_PAGE, eeaddress >> 8, eeaddress, buffer[i]);
         }
+    }
+}
+
+/**
+ * @brief Write loaded page buffer of ISP target into its memory
+ *
+ * For flash, the extended address byte set by the preceding isp_loadPage()
+ * is used.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
+ * @param address Target address of page start
+ */
+void isp_commitPage(uint8_t memtype, uint32_t address) {
 
-        address++;
-        length--;
+    if (memtype == ISP_MEMTYPE_FLASH) {
 
+        uint16_t wordaddress = address >> 1;
+        isp_instruction(ISP_CMD_WRITE_PROGRAM_MEMORY_PAGE, wordaddress >> 8, wordaddress, 0);
+        isp_waitReady(device_current.delayflash);
+
+    } else {
+
+        isp_instruction(ISP_CMD_WRITE_EEPROM_MEMORY_PAGE, address >> 8, address, 0);
+        isp_waitReady(device_current.delayeeprom);
     }
 }
 
 /**
- * @brief Read data from target and verify its content with given flash block
- * @param mempointer Pointer to data block to verify with
- * @param address Address of target
- * @param length Length of data block to verify
- * @retval 0 Verification error
- * @retval 1 Verification successful
+ * @brief Read memory block of ISP target into given SRAM buffer
+ *
+ * For flash, the block must not cross a 128kB boundary. With slow
+ * programming clock the transfer runs interrupt driven in background: the
+ * buffer is valid after isp_waitTransfer() returned.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
+ * @param address Target address of first byte to read
+ * @param buffer Pointer to buffer to store read data
+ * @param length Length of data block
  */
-uint8_t isp_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length) {
-    uint8_t data[4];
-    uint8_t hiaddress = 0xff;
-    while (length > 0) {
+void isp_readPage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length) {
+
+    uint16_t i;
+
+    if (memtype == ISP_MEMTYPE_FLASH) {
+
+        isp_loadExtendedAddress(address);
+
+        uint16_t wordaddress = address >> 1;
+        uint8_t highbyte = address & 1;
+
+        if (isp_queueasync) {
+            isp_queueStart(ISP_CMD_READ_PROGRAM_MEMORY_PAGE_LOW_BYTE, 1, 1, wordaddress, highbyte, buffer, length);
+            return;
+        }
+
+        for (i = 0; i < length; i++) {
+            buffer[i] = isp_instruction(ISP_CMD_READ_PROGRAM_MEMORY_PAGE_LOW_BYTE | (highbyte << 3), wordaddress >> 8, wordaddress, 0);
+            wordaddress += highbyte;
+            highbyte ^= 1;
+        }
+
+    } else {
+
+        if (isp_queueasync) {
+            isp_queueStart(ISP_CMD_READ_EEPROM_MEMORY, 0, 1, address, 0, buffer, length);
+            return;
+        }
 
-        // load extended address
-        if ((address >> 17) != hiaddress) {
-            hiaddress = address >> 17;
-            data[0] = ISP_CMD_LOAD_EXTENDED_ADDRESS_BYTE;
-            data[1] = 0;
-            data[2] = hiaddress;
-            data[3] = 0;
-            isp_transmit(data, sizeof (data));
+        uint16_t eeaddress = address;
+        for (i = 0; i < length; i++, eeaddress++) {
+            buffer[i] = isp_instruction(ISP_CMD_READ_EEPROM_MEMORY, eeaddress >> 8, eeaddress, 0);
         }
+    }
+}
 
-        // read byte
-        data[0] = ISP_CMD_READ_PROGRAM_MEMORY_PAGE_LOW_BYTE | ((address & 1) << 3);
-        data[1] = address >> 9;
-        data[2] = address >> 1;
-        data[3] = 0;
-        isp_transmit(data, sizeof (data));
+/**
+ * @brief Read memory block of ISP target and compare it with given SRAM buffer
+ *
+ * For flash, the block must not cross a 128kB boundary.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
+ * @param address Target address of first byte to compare
+ * @param buffer Pointer to data to compare with
+ * @param length Length of data block
+ * @retval 0 Content differs
+ * @retval 1 Content is equal
+ */
+uint8_t isp_comparePage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length) {
 
-        if (flash_readbyte(mempointer++) != data[3]) return 0;
+    uint16_t i;
 
-        address++;
-        length--;
+    if (memtype == ISP_MEMTYPE_FLASH) {
 
+        isp_loadExtendedAddress(address);
+
+        uint16_t wordaddress = address >> 1;
+        uint8_t highbyte = address & 1;
+        for (i = 0; i < length; i++) {
+            if (isp_instruction(ISP_CMD_READ_PROGRAM_MEMORY_PAGE_LOW_BYTE | (highbyte << 3), wordaddress >> 8, wordaddress, 0) != buffer[i]) return 0;
+            wordaddress += highbyte;
+            highbyte ^= 1;
+        }
+
+    } else {
+
+        uint16_t eeaddress = address;
+        for (i = 0; i < length; i++, eeaddress++) {
+            if (isp_instruction(ISP_CMD_READ_EEPROM_MEMORY, eeaddress >> 8, eeaddress, 0) != buffer[i]) return 0;
+        }
     }
+
     return 1;
 }
 
 /**
- * @brief Transfer given memory block to ISP target eeprom
+ * @brief Bytes staged per call of idle task
+ */
+#define ISP_STAGE_STEP 8
+
+/**
+ * @brief Page buffers in SRAM (one is loaded while the other one is staged)
+ */
+static uint8_t isp_pagebuffer[2][ISP_PAGEBUFFER_SIZE];
+
+static uint32_t isp_stagepointer;   ///< Next script memory byte to stage
+static uint8_t * isp_stagebuffer;   ///< Next buffer position to stage to
+static uint16_t isp_stagelength;    ///< Number of bytes still to stage
+
+/**
+ * @brief Copy data block from script memory into SRAM
+ * @param mempointer Pointer to start of data in script memory
+ * @param buffer Pointer to destination buffer
+ * @param length Length of data block
+ */
+static void isp_fetch(uint32_t mempointer, uint8_t * buffer, uint16_t length) {
+    while (length--) {
+        *buffer++ = flash_readbyte(mempointer++);
+    }
+}
+
+/**
+ * @brief Idle task: copy some bytes of staged data block into SRAM
+ */
+static void isp_stageTask() {
+    uint8_t n = ISP_STAGE_STEP;
+    while (isp_stagelength && n--) {
+        *isp_stagebuffer++ = flash_readbyte(isp_stagepointer++);
+        isp_stagelength--;
+    }
+}
+
+/**
+ * @brief Start staging of data block from script memory into SRAM
+ * @param mempointer Pointer to start of data in script memory
+ * @param buffer Pointer to destination buffer
+ * @param length Length of data block
+ */
+static void isp_stage(uint32_t mempointer, uint8_t * buffer, uint16_t length) {
+    isp_stagepointer = mempointer;
+    isp_stagebuffer = buffer;
+    isp_stagelength = length;
+}
+
+/**
+ * @brief Finish staging of data block
+ */
+static void isp_stageFinish() {
+    while (isp_stagelength) isp_stageTask();
+}
+
+/**
+ * @brief Get offset of given address within its target page
+ *
+ * All AVR page sizes are powers of two and are masked; the 32 bit division
+ * is only done for other page sizes given by a script.
+ *
+ * @param address Target address
+ * @param pagesize Size of target page
+ * @return Offset within page
+ */
+uint16_t isp_pageOffset(uint32_t address, uint16_t pagesize) {
+
+    if ((pagesize & (pagesize - 1)) == 0) return (uint16_t) address & (pagesize - 1);
+
+    return address % pagesize;
+}
+
+/**
+ * @brief Get length of next chunk which fits into page and SRAM page buffer
+ * @param address Target address
+ * @param length Remaining length of data block
+ * @param pagesize Size of target page
+ * @return Length of chunk
+ */
+static uint16_t isp_chunkLength(uint32_t address, uint32_t length, uint16_t pagesize) {
+
+    uint16_t chunk = pagesize - isp_pageOffset(address, pagesize);
+    if (chunk > ISP_PAGEBUFFER_SIZE) chunk = ISP_PAGEBUFFER_SIZE;
+    if (chunk > length) chunk = length;
+
+    return chunk;
+}
+
+/**
+ * @brief Write given SRAM buffer to ISP target eeprom in byte mode
+ *
+ * Every byte is read first and only written if it differs.
+ *
+ * @param address Target address of first byte in buffer
+ * @param buffer Pointer to data to write
+ * @param length Length of data block
+ */
+static void isp_writeEEPROMBytes(uint32_t address, uint8_t * buffer, uint16_t length) {
+
+    uint16_t eeaddress = address;
+    uint16_t i;
+
+    for (i = 0; i < length; i++, eeaddress++) {
+        if (isp_instruction(ISP_CMD_READ_EEPROM_MEMORY, eeaddress >> 8, eeaddress, 0) == buffer[i]) continue;
+        isp_instruction(ISP_CMD_WRITE_EEPROM_MEMORY, eeaddress >> 8, eeaddress, buffer[i]);
+        isp_waitReady(device_current.delayeeprom);
+        if (isp_syncerror) return;
+    }
+}
+
+/**
+ * @brief Write given SRAM bytes to ISP target and verify them
+ *
+ * Used for small per-unit data like serial numbers. Flash locations have to be
+ * erased; if the page size of the device is unknown, every byte is written
+ * with its own page write.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
+ * @param address Target address of first byte
+ * @param buffer Pointer to data to write
+ * @param length Length of data block
+ * @retval 0 Verification error
+ * @retval 1 Everything okay
+ */
+uint8_t isp_writeBytes(uint8_t memtype, uint32_t address, uint8_t * buffer, uint8_t length) {
+
+    if (memtype == ISP_MEMTYPE_EEPROM) {
+
+        isp_writeEEPROMBytes(address, buffer, length);
+
+    } else {
+
+        uint16_t pagesize = device_current.flashpagesize;
+        uint8_t i = 0;
+
+        if (pagesize == 0) pagesize = 1;
+
+        while (i < length) {
+
+            uint32_t byteaddress = address + i;
+            uint16_t chunk = isp_chunkLength(byteaddress, length - i, pagesize);
+
+            isp_loadPage(ISP_MEMTYPE_FLASH, byteaddress, buffer + i, chunk);
+            isp_commitPage(ISP_MEMTYPE_FLASH, byteaddress - isp_pageOffset(byteaddress, pagesize));
+
+            i += chunk;
+        }
+    }
+
+    return isp_comparePage(memtype, address, buffer, length) && !isp_syncerror;
+}
+
+/**
+ * @brief Write pending flash page
+ */
+static void isp_commitPending() {
+
+    if (!isp_flashpending) return;
+
+    // verify may have loaded another extended address since the page load
+    isp_loadExtendedAddress(isp_flashpendingpage);
+    isp_commitPage(ISP_MEMTYPE_FLASH, isp_flashpendingpage);
+    isp_flashpending = 0;
+}
+
+/**
+ * @brief Transfer given memory block to ISP target
+ *
+ * A flash block which ends within a page leaves this page pending: the next
+ * flash block continues to load it if it starts in the same page, otherwise
+ * the page is written first. So adjacent blocks sharing a page cost only one
+ * page write. isp_flushFlash() writes a pending page.
+ *
+ * While a page is loaded or written by the target, the next chunk is staged
+ * from script memory into the second page buffer. EEPROM chunks which are
+ * already equal to the target content are neither loaded nor written.
+ *
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
  * @param mempointer Pointer to start of data to transfer
  * @param address Target address
  * @param length Length of data block
- * @param pagesize Size of target flash page
+ * @param pagesize Size of target page (<= 1: eeprom byte mode; flash: 1 writes
+ *        every byte with its own page write, 0 is invalid and not written)
  */
-void isp_writeEEPROM(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+static void isp_write(uint8_t memtype, uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
 
-    uint8_t doflush = 0;
-    uint8_t data[4];
-    while (length > 0) {
+    // flash has no byte mode
+    if ((memtype == ISP_MEMTYPE_FLASH) && (pagesize == 0)) return;
+
+    uint8_t bytemode = (memtype == ISP_MEMTYPE_EEPROM) && (pagesize <= 1);
+    if (bytemode) pagesize = ISP_PAGEBUFFER_SIZE;
 
-        // load byte
-        data[1] = address >> 8;
-        data[2] = address & 0xff;
-        data[3] = flash_readbyte(mempointer++);
-
-        if (pagesize <= 1) {
-            
-            // single byte programming
-            data[0] = ISP_CMD_WRITE_EEPROM_MEMORY;
-            isp_transmit(data, sizeof (data));
-            clock_delayFast(ISP_DELAY_EEPROM);
-            
+    uint8_t * buffer = isp_pagebuffer[0];
+    uint8_t * next = isp_pagebuffer[1];
+    uint16_t chunk = isp_chunkLength(address, length, pagesize);
+    uint8_t pagedirty = 0;
+
+    if ((memtype == ISP_MEMTYPE_FLASH) && isp_flashpending && (length > 0)) {
+        if ((pagesize == isp_flashpendingsize) && (address - isp_pageOffset(address, pagesize) == isp_flashpendingpage)) {
+            // continue loading the pending page
+            isp_flashpending = 0;
+            pagedirty = 1;
         } else {
-            
-            // page programming
-            data[0] = ISP_CMD_LOAD_EEPROM_MEMORY_PAGE;
-            isp_transmit(data, sizeof (data));
-            doflush = 1;
+            isp_commitPending();
+        }
+    }
 
-            if ((((address + 1) % pagesize) == 0) || ((length == 1) && (doflush))) {
-                // flush page
+    isp_fetch(mempointer, buffer, chunk);
+    clock_setIdleTask(isp_stageTask);
+
+    while (length > 0) {
+
+        mempointer += chunk;
+        length -= chunk;
+
+        uint16_t nextchunk = isp_chunkLength(address + chunk, length, pagesize);
+
+        if (bytemode) {
+            isp_stage(mempointer, next, nextchunk);
+            isp_writeEEPROMBytes(address, buffer, chunk);
+        } else {
+            if ((memtype == ISP_MEMTYPE_EEPROM) && isp_comparePage(memtype, address, buffer, chunk)) {
+                // target already holds this data
+                isp_stage(mempointer, next, nextchunk);
+            } else {
+                // start load first, so staging of the next chunk into the
+                // other buffer overlaps with the (background) transfer
+                isp_loadPage(memtype, address, buffer, chunk);
+                isp_stage(mempointer, next, nextchunk);
+                isp_waitTransfer();
+                pagedirty = 1;
+            }
 
-                data[0] = ISP_CMD_WRITE_EEPROM_MEMORY_PAGE;
-                data[1] = address >> 8;
-                data[2] = address & 0xfc;
-                data[3] = 0;
-                isp_transmit(data, sizeof (data));
+            uint16_t endoffset = isp_pageOffset(address + chunk, pagesize);
 
-                clock_delayFast(ISP_DELAY_EEPROM);
+            if ((!isp_syncerror) && pagedirty && ((endoffset == 0) || (length == 0))) {
+                uint32_t pagestart = address - isp_pageOffset(address, pagesize);
 
-                doflush = 0;
+                if ((memtype == ISP_MEMTYPE_FLASH) && (endoffset != 0)) {
+                    // block ends within page: leave it open for next block
+                    isp_flashpending = 1;
+                    isp_flashpendingpage = pagestart;
+                    isp_flashpendingsize = pagesize;
+                } else {
+                    // flush page
+                    isp_commitPage(memtype, pagestart);
+                }
+                pagedirty = 0;
             }
         }
 
-        address++;
-        length--;
+        if (isp_syncerror) break;
+
+        address += chunk;
+
+        isp_stageFinish();
 
+        uint8_t * tmp = buffer;
+        buffer = next;
+        next = tmp;
+        chunk = nextchunk;
     }
+
+    clock_setIdleTask(0);
 }
 
 /**
- * @brief Read data from target and verify its content with given eeprom block
+ * @brief Transfer given memory block to ISP target flash
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Target address
+ * @param length Length of data block
+ * @param pagesize Size of target flash page (overridden by device table)
+ */
+void isp_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+
+    if (device_current.flashpagesize) pagesize = device_current.flashpagesize;
+
+    isp_write(ISP_MEMTYPE_FLASH, mempointer, address, length, pagesize);
+}
+
+/**
+ * @brief Read data from target and verify its content with given memory block
+ * @param memtype Memory type (ISP_MEMTYPE_FLASH or ISP_MEMTYPE_EEPROM)
  * @param mempointer Pointer to data block to verify with
  * @param address Address of target
  * @param length Length of data block to verify
  * @retval 0 Verification error
  * @retval 1 Verification successful
  */
-uint8_t isp_verifyEEPROM(uint32_t mempointer, uint32_t address, uint32_t length) {
-    uint8_t data[4];
+static uint8_t isp_verify(uint8_t memtype, uint32_t mempointer, uint32_t address, uint32_t length) {
+
     while (length > 0) {
 
-        // read byte
-        data[0] = ISP_CMD_READ_EEPROM_MEMORY;
-        data[1] = address >> 8;
-        data[2] = address & 0xff;
-        data[3] = 0;
-        isp_transmit(data, sizeof (data));
+        // chunks are aligned to buffer size, so they never cross 128kB boundaries
+        uint16_t chunk = isp_chunkLength(address, length, ISP_PAGEBUFFER_SIZE);
 
-        if (flash_readbyte(mempointer++) != data[3]) return 0;
+        // read target (possibly in background) while fetching script data
+        isp_readPage(memtype, address, isp_pagebuffer[1], chunk);
+        isp_fetch(mempointer, isp_pagebuffer[0], chunk);
+        isp_waitTransfer();
 
-        address++;
-        length--;
+        if ((memcmp(isp_pagebuffer[0], isp_pagebuffer[1], chunk) != 0) || isp_syncerror) return 0;
 
+        mempointer += chunk;
+        address += chunk;
+        length -= chunk;
     }
     return 1;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Verify deferred flash segments if their page was written
+ * @retval 0 Verification error
+ * @retval 1 Verification successful or page still pending
+ */
+static uint8_t isp_verifyDeferred() {
+
+    uint8_t success = 1;
+    uint8_t i;
+
+    if (isp_flashpending) return 1;
+
+    for (i = 0; i < isp_deferredcount; i++) {
+        if (!isp_verify(ISP_MEMTYPE_FLASH, isp_deferred[i].mempointer, isp_deferred[i].address, isp_deferred[i].length)) success = 0;
+    }
+    isp_deferredcount = 0;
+
+    return success;
+}
+
+/**
+ * @brief Read data from target and verify its content with given flash block
+ *
+ * The part of the block within a pending page is verified after the page was
+ * written, by a later call of this function or by isp_flushFlash().
+ *
+ * @param mempointer Pointer to data block to verify with
+ * @param address Address of target
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+uint8_t isp_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length) {
+
+    uint8_t success = isp_verifyDeferred();
+
+    if (isp_flashpending && (address + length > isp_flashpendingpage)) {
+
+        if (isp_deferredcount == ISP_DEFERRED_SEGMENTS) {
+            // no more space: write page now
+            isp_commitPending();
+            if (!isp_verifyDeferred()) success = 0;
+        } else {
+            // the block ends in the pending page
+            uint32_t start = (address > isp_flashpendingpage) ? address : isp_flashpendingpage;
+            uint16_t tail = address + length - start;
+
+            isp_deferred[isp_deferredcount].mempointer = mempointer + (start - address);
+            isp_deferred[isp_deferredcount].address = start;
+            isp_deferred[isp_deferredcount].length = tail;
+            isp_deferredcount++;
+
+            length -= tail;
+        }
+    }
+
+    return isp_verify(ISP_MEMTYPE_FLASH, mempointer, address, length) && success;
+}
+
+/**
+ * @brief Write pending flash page and verify its deferred segments
+ * @retval 0 Verification error
+ * @retval 1 Verification successful or nothing pending
+ */
+uint8_t isp_flushFlash() {
+
+    if (!isp_flashpending && (isp_deferredcount == 0)) return 1;
+
+    isp_commitPending();
+
+    return isp_verifyDeferred() && !isp_syncerror;
+}
+
+/**
+ * @brief Transfer given memory block to ISP target eeprom
+ *
+ * Page or byte mode is selected by the device table (page size 1: byte mode
+ * only). Only for unknown devices the page size given by the script decides.
+ *
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Target address
+ * @param length Length of data block
+ * @param pagesize Size of target eeprom page (overridden by device table)
+ */
+void isp_writeEEPROM(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+
+    if (device_current.eeprompagesize) pagesize = device_current.eeprompagesize;
+
+    isp_write(ISP_MEMTYPE_EEPROM, mempointer, address, length, pagesize);
+}
+
+/**
+ * @brief Read data from target and verify its content with given eeprom block
+ * @param mempointer Pointer to data block to verify with
+ * @param address Address of target
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+uint8_t isp_verifyEEPROM(uint32_t mempointer, uint32_t address, uint32_t length) {
+    return isp_verify(ISP_MEMTYPE_EEPROM, mempointer, address, length);
+}
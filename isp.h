@@ -31,16 +31,45 @@
 #define ISP_CMD_WRITE_EEPROM_MEMORY_PAGE 0xC2
 #define ISP_CMD_WRITE_EEPROM_MEMORY 0xC0
 #define ISP_CMD_READ_EEPROM_MEMORY 0xA0
+#define ISP_CMD_READ_SIGNATURE_BYTE 0x30
+#define ISP_CMD_POLL_READY 0xF0
+#define ISP_CMD_WRITE 0xAC
+#define ISP_CMD_WRITE_CHIP_ERASE 0x80
+#define ISP_CMD_WRITE_LOCK_BITS 0xE0
+#define ISP_CMD_WRITE_FUSE_BITS 0xA0
+#define ISP_CMD_WRITE_FUSE_HIGH_BITS 0xA8
+#define ISP_CMD_WRITE_EXTENDED_FUSE_BITS 0xA4
 
 #define ISP_DELAY_FLASH CLOCK_TICKER_FAST_5MS
 #define ISP_DELAY_EEPROM CLOCK_TICKER_FAST_10MS
 
+#define ISP_SCKOPTION_SLOWEST 0x03 ///< SCK option: fosc/128
+
+#define ISP_MEMTYPE_FLASH 0     ///< Memory type: Program memory
+#define ISP_MEMTYPE_EEPROM 1    ///< Memory type: EEPROM
+
+#define ISP_DEFERRED_SEGMENTS 8 ///< Flash segments in a pending page waiting for verification
+
 
 uint8_t isp_connect(uint8_t sckoption);
 uint8_t isp_disconnect();
+uint8_t isp_probe();
+void isp_setSCK(uint8_t sckoption);
+uint8_t isp_getSCK();
+void isp_setSyncCheck(uint8_t enable);
+uint8_t isp_getSyncError();
 void isp_transmit(uint8_t * data, uint8_t len);
+void isp_waitTransfer();
+void isp_completeInstruction(uint8_t cmd1, uint8_t cmd2);
+void isp_loadPage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length);
+void isp_commitPage(uint8_t memtype, uint32_t address);
+void isp_readPage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length);
+uint8_t isp_comparePage(uint8_t memtype, uint32_t address, uint8_t * buffer, uint16_t length);
+uint16_t isp_pageOffset(uint32_t address, uint16_t pagesize);
+uint8_t isp_writeBytes(uint8_t memtype, uint32_t address, uint8_t * buffer, uint8_t length);
 void isp_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize);
 uint8_t isp_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length);
+uint8_t isp_flushFlash();
 void isp_writeEEPROM(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize);
 uint8_t isp_verifyEEPROM(uint32_t mempointer, uint32_t address, uint32_t length);
 
@@ -61,6 +61,28 @@
 #include "script.h"
 
 
+/**
+ * @brief Time the switch has to be released before next press is accepted
+ */
+#define KEY_DEBOUNCE CLOCK_TICKER_SLOW_100MS
+
+#ifdef AUTOSTART
+
+/**
+ * @brief Time target presence has to be stable before it is accepted
+ */
+#define AUTOSTART_SETTLE CLOCK_TICKER_SLOW_100MS
+
+#ifdef hal_getTargetSense
+#define AUTOSTART_POLL 0    ///< Sense pin is cheap, check it on every loop
+#define autostart_getTarget() hal_getTargetSense()
+#else
+#define AUTOSTART_POLL CLOCK_TICKER_SLOW_100MS  ///< Interval of sync attempts
+#define autostart_getTarget() isp_probe()
+#endif
+
+#endif
+
 /**
  * @brief Main routine of firmware and application entry point
  * @return Application return code
@@ -70,6 +92,10 @@ int main(void) {
     hal_init();
     clock_init();
 
+#ifdef NORSTORE
+    nor_init();
+#endif
+
     // enable interrupts
     sei();
 
@@ -77,8 +103,22 @@ int main(void) {
     uint8_t toggle = 0;
     uint16_t counter = counter_read();
     uint8_t success = 1;
+    uint8_t synclost = 0;
     uint8_t keyticker = clock_getTickerSlow();
-    uint8_t keylocked = 1;
+    uint8_t keystate = hal_getSwitch();
+    uint8_t keyarmed = 0;
+
+#ifdef AUTOSTART
+    uint8_t target = 0;
+    uint8_t targetraw = 0;
+    uint8_t targetticker = clock_getTickerSlow();
+    uint8_t pollticker = clock_getTickerSlow();
+#endif
+
+#ifdef DRYRUN
+    // switch held at power up: estimate script duration without target
+    if (keystate) success = script_dryrun();
+#endif
 
     hal_setLEDgreen(1);
     hal_setLEDred(0);
@@ -86,25 +126,47 @@ int main(void) {
     // main loop	
     while (1) {
 
-        if (keylocked) {
+        uint8_t start = 0;
+
+        // do debouncing: every edge is timestamped, a press is accepted
+        // immediately if the switch was released long enough before
+
+        uint8_t key = hal_getSwitch();
+        if (key != keystate) {
+            keystate = key;
+            keyticker = clock_getTickerSlow();
+            if (key && keyarmed) start = 1;
+            keyarmed = 0;
+        } else if (!key && (clock_getTickerSlowDiff(keyticker) > KEY_DEBOUNCE)) {
+            keyarmed = 1;
+        }
+
+#ifdef AUTOSTART
+        // detect target: start when it is seated, re-arm when it is removed
 
-            // do debouncing
-            
-            if (hal_getSwitch()) {
-                keyticker = clock_getTickerSlow();
-            } else if (clock_getTickerSlowDiff(keyticker) > CLOCK_TICKER_SLOW_500MS) {
-                keylocked = 0;
+        if (clock_getTickerSlowDiff(pollticker) >= AUTOSTART_POLL) {
+            pollticker = clock_getTickerSlow();
+
+            uint8_t present = autostart_getTarget();
+            if (present != targetraw) {
+                targetraw = present;
+                targetticker = clock_getTickerSlow();
+            } else if ((present != target) && (clock_getTickerSlowDiff(targetticker) >= AUTOSTART_SETTLE)) {
+                target = present;
+                if (target) start = 1;
             }
+        }
+#endif
 
-        } else if (hal_getSwitch()) {
+        if (start) {
 
-            // key pressed
-            
             if (counter > 0) {
                 hal_setLEDgreen(1);
                 hal_setLEDred(1);
 
-                success = script_run();
+                uint8_t result = script_run();
+                success = (result == SCRIPT_RESULT_OK);
+                synclost = (result == SCRIPT_RESULT_SYNCLOST);
                 counter = counter_read();
 
                 hal_setLEDgreen(success);
@@ -113,19 +175,25 @@ int main(void) {
                 ticker = clock_getTickerSlow();
             } else {
                 success = 0;
+                synclost = 0;
             }
-            
-            keylocked = 1;
+
+            keyarmed = 0;
             keyticker = clock_getTickerSlow();
 
         }
 
+        // check script data in background, a corrupted script shows error
+        if (script_check() == SCRIPT_CHECK_BAD) success = 0;
+
         // do led signaling
         if (clock_getTickerSlowDiff(ticker) > CLOCK_TICKER_SLOW_250MS) {
             ticker = clock_getTickerSlow();
             toggle = !toggle;
 
+            // lost sync: alternate green and red
             if (counter == 0) hal_setLEDgreen(toggle);
+            else if (synclost) hal_setLEDgreen(!toggle);
             else hal_setLEDgreen(success);
 
             if (!success) hal_setLEDred(toggle);
@@ -136,4 +204,3 @@ int main(void) {
 
     return (0);
 }
-
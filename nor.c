@@ -0,0 +1,147 @@
+/**
+ * @file nor.c
+ *
+ * @brief This file contains the external NOR flash image store
+ *
+ * With NORSTORE defined, script data is read from a serial NOR flash (25xx
+ * compatible) instead of the internal flash. The NOR flash is connected to
+ * USART0 in SPI master mode (XCK0: SCK, TXD0: SI, RXD0: SO) with chip select
+ * on NOR_CS. The script header starts at NOR address 0.
+ *
+ * Reads are served from an SRAM buffer. A fast read command stays open, so
+ * sequential reads refill the buffer with back to back transfers at fosc/2.
+ * Only a jump to an address outside of the buffer restarts the command.
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include <inttypes.h>
+#include <avr/io.h>
+#include "clock.h"
+#include "hal.h"
+#include "nor.h"
+
+#ifdef NORSTORE
+
+#if !defined(USART_UCSRC_MSPIM) || defined(UPDI) || defined(BENCHMARK) || defined(DRYRUN)
+#error "NORSTORE needs USART0 in SPI master mode"
+#endif
+
+static uint8_t nor_buffer[NOR_BUFFER_SIZE]; ///< Read-ahead buffer
+static uint32_t nor_address;    ///< NOR address of first byte in buffer
+static uint8_t nor_fill;        ///< Number of valid bytes in buffer
+static uint8_t nor_open;        ///< Fast read is running, it continues after the buffer
+
+/**
+ * @brief Transfer one byte to NOR flash
+ * @param data Byte to send
+ * @return Received byte
+ */
+static uint8_t nor_transfer(uint8_t data) {
+    USART_UDR = data;
+    while (!(USART_UCSRA & (1 << USART_RXC)));
+    return USART_UDR;
+}
+
+/**
+ * @brief Start fast read at given address
+ * @param address NOR address
+ */
+static void nor_start(uint32_t address) {
+
+    NOR_CS_OUT |= (1 << NOR_CS);
+    NOR_CS_OUT &= ~(1 << NOR_CS);
+
+    nor_transfer(NOR_CMD_FAST_READ);
+    nor_transfer(address >> 16);
+    nor_transfer(address >> 8);
+    nor_transfer(address);
+    nor_transfer(0); // dummy byte
+
+    nor_open = 1;
+}
+
+/**
+ * @brief Fill read-ahead buffer from running fast read
+ *
+ * The transmitter is double buffered: the next dummy byte is written before
+ * the current one is received, so the clock runs without gaps.
+ */
+static void nor_fillBuffer() {
+
+    uint8_t i;
+
+    USART_UDR = 0xff;
+    for (i = 0; i < NOR_BUFFER_SIZE; i++) {
+        if (i < NOR_BUFFER_SIZE - 1) {
+            while (!(USART_UCSRA & (1 << USART_UDRE)));
+            USART_UDR = 0xff;
+        }
+        while (!(USART_UCSRA & (1 << USART_RXC)));
+        nor_buffer[i] = USART_UDR;
+    }
+
+    nor_fill = NOR_BUFFER_SIZE;
+}
+
+/**
+ * @brief Initialize USART0 in SPI master mode and wake up NOR flash
+ */
+void nor_init() {
+
+    NOR_CS_OUT |= (1 << NOR_CS);
+    NOR_CS_DDR |= (1 << NOR_CS);
+
+    // SPI mode 0 with fosc/2
+    USART_UBRR = 0;
+    USART_XCK_DDR |= (1 << USART_XCK);
+    USART_UCSRC = USART_UCSRC_MSPIM;
+    USART_UCSRB = (1 << USART_RXEN) | (1 << USART_TXEN);
+    USART_UBRR = 0;
+
+    NOR_CS_OUT &= ~(1 << NOR_CS);
+    nor_transfer(NOR_CMD_RELEASE_POWERDOWN);
+    NOR_CS_OUT |= (1 << NOR_CS);
+
+    // tRES1 (a single tick may elapse immediately, two last at least 128us)
+    clock_delayFast(2);
+
+    nor_open = 0;
+    nor_fill = 0;
+}
+
+/**
+ * @brief Read one byte of image store
+ * @param address NOR address
+ * @return Byte read
+ */
+uint8_t nor_readbyte(uint32_t address) {
+
+    // wraps for addresses below buffer
+    uint32_t offset = address - nor_address;
+
+    if (offset >= nor_fill) {
+        if (!nor_open || (offset != nor_fill)) nor_start(address);
+        nor_address = address;
+        nor_fillBuffer();
+        offset = 0;
+    }
+
+    return nor_buffer[offset];
+}
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * @file nor.h
+ *
+ * @brief This file contains definitions for the external NOR flash image store
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef _NOR_
+#define _NOR_
+
+#define NOR_CMD_FAST_READ 0x0B
+#define NOR_CMD_RELEASE_POWERDOWN 0xAB
+
+#ifndef NOR_SIZE
+#define NOR_SIZE 0x400000UL     ///< Size of NOR flash in bytes (default: 32 Mbit)
+#endif
+
+#define NOR_BUFFER_SIZE 32      ///< Read-ahead buffer size in bytes
+
+void nor_init();
+uint8_t nor_readbyte(uint32_t address);
+
+#endif
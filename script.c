@@ -25,32 +25,171 @@
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 #include "clock.h"
 #include "hal.h"
 #include "isp.h"
 #include "counter.h"
+#include "updi.h"
+#include "tpi.h"
+#include "bench.h"
+#include "device.h"
+#include "uart.h"
 #include "script.h"
 
+#if defined(DRYRUN) && !defined(USART_UDR)
+#error "DRYRUN needs USART for report output"
+#endif
+
 /**
  * @brief Pointer to script data in flash memory
+ *
+ * Script data starts with a header containing length and CRC32 of the
+ * following commands (both most significant byte first).
+ */
+unsigned char scriptdata[] SCRIPT_SECTION = {0x00, 0x00, 0x00, 0x01, 0xff, 0x00, 0x00, 0x00, SCRIPT_CMD_END}; // dummy (is overwritten by hex creator)
+
+/**
+ * @brief CRC32 (0xEDB88320 reflected) lookup table for one nibble
+ */
+static const uint32_t script_crctable[16] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint8_t script_checkstate = SCRIPT_CHECK_PENDING; ///< Cached result of integrity check
+static uint8_t script_checkstarted = 0; ///< Header of script was read
+static uint32_t script_checkpointer; ///< Next script byte to check
+static uint32_t script_checkremaining; ///< Number of script bytes left to check
+static uint32_t script_checkcrc; ///< CRC32 expected from header
+static uint32_t script_crc; ///< Running CRC32
+
+/**
+ * @brief Check integrity of script data incrementally
+ *
+ * Every call processes up to SCRIPT_CHECK_CHUNK bytes, so it can be called from
+ * the idle loop without delaying other tasks. The result is cached.
+ *
+ * @retval SCRIPT_CHECK_PENDING Check not finished yet
+ * @retval SCRIPT_CHECK_OK Script data is intact
+ * @retval SCRIPT_CHECK_BAD Script data is corrupted
+ */
+uint8_t script_check() {
+
+    if (script_checkstate != SCRIPT_CHECK_PENDING) return script_checkstate;
+
+    if (!script_checkstarted) {
+
+        DEFINE_DATAPOINTER;
+        uint8_t i;
+
+        for (i = 0; i < 4; i++)
+            script_checkremaining = (script_checkremaining << 8) | flash_readbyte(scriptdata_p++);
+        for (i = 0; i < 4; i++)
+            script_checkcrc = (script_checkcrc << 8) | flash_readbyte(scriptdata_p++);
+
+        script_checkpointer = scriptdata_p;
+        script_crc = 0xffffffff;
+        script_checkstarted = 1;
+
+        // erased or garbage header
+        if ((script_checkremaining == 0) || (script_checkremaining > SCRIPT_DATAEND - script_checkpointer)) {
+            script_checkstate = SCRIPT_CHECK_BAD;
+            return script_checkstate;
+        }
+    }
+
+    uint8_t count = SCRIPT_CHECK_CHUNK;
+    while ((script_checkremaining > 0) && (count-- > 0)) {
+        script_crc ^= flash_readbyte(script_checkpointer++);
+        script_crc = (script_crc >> 4) ^ pgm_read_dword(&script_crctable[script_crc & 0x0f]);
+        script_crc = (script_crc >> 4) ^ pgm_read_dword(&script_crctable[script_crc & 0x0f]);
+        script_checkremaining--;
+    }
+
+    if (script_checkremaining == 0) {
+        if ((script_crc ^ 0xffffffff) == script_checkcrc) script_checkstate = SCRIPT_CHECK_OK;
+        else script_checkstate = SCRIPT_CHECK_BAD;
+    }
+
+    return script_checkstate;
+}
+
+/**
+ * @brief Build serial number bytes
+ * @param buffer Buffer to store bytes to (at least 5 bytes)
+ * @param serial Serial number
+ * @param width Number of bytes of serial number (1..4)
+ * @param flags SCRIPT_SERIAL_* flags
+ * @return Number of bytes stored in buffer
  */
-unsigned char scriptdata[] SCRIPT_SECTION = {SCRIPT_CMD_END}; // dummy (is overwritten by hex creator)
+static uint8_t script_buildSerial(uint8_t * buffer, uint32_t serial, uint8_t width, uint8_t flags) {
+
+    uint8_t crc = 0;
+    uint8_t i;
+
+    if (width < 1) width = 1;
+    if (width > 4) width = 4;
+
+    for (i = 0; i < width; i++) {
+        uint8_t pos = (flags & SCRIPT_SERIAL_BIGENDIAN) ? width - 1 - i : i;
+        buffer[pos] = serial;
+        serial >>= 8;
+    }
+
+    if (!(flags & SCRIPT_SERIAL_CRC8)) return width;
+
+    for (i = 0; i < width; i++) crc = _crc_ibutton_update(crc, buffer[i]);
+    buffer[width] = crc;
+
+    return width + 1;
+}
+
+/**
+ * @brief Release target after an error: close ISP and (if open) UPDI session
+ */
+static void script_release() {
+    isp_disconnect();
+#ifdef UPDI
+    updi_disconnect();
+#endif
+}
 
 /**
  * @brief Execute script stored in flash memory
- * @retval 1 Everything okay
- * @retval 0 Error occured
+ * @retval SCRIPT_RESULT_OK Everything okay
+ * @retval SCRIPT_RESULT_ERROR Error occured
+ * @retval SCRIPT_RESULT_SYNCLOST Echo check detected loss of sync with target
  */
 uint8_t script_run() {
 
     DEFINE_DATAPOINTER;
 
+    // finish integrity check, a corrupted script must not touch the target
+    uint8_t check;
+    while ((check = script_check()) == SCRIPT_CHECK_PENDING);
+    if (check != SCRIPT_CHECK_OK) return SCRIPT_RESULT_ERROR;
+
+    scriptdata_p += SCRIPT_HEADER_LENGTH;
+
+    isp_setSyncCheck(0);
+
     uint8_t cmd;
     while (1) {
         cmd = flash_readbyte(scriptdata_p++);
 
         uint8_t success = 0;
 
+        // a flash page shared with the previous block is written and
+        // verified before any other command
+        if ((cmd != SCRIPT_CMD_FLASH) && !isp_flushFlash()) {
+            uint8_t result = isp_getSyncError() ? SCRIPT_RESULT_SYNCLOST : SCRIPT_RESULT_ERROR;
+            script_release();
+            return result;
+        }
+
         switch (cmd) {
 
             case SCRIPT_CMD_CONNECT:
@@ -77,7 +216,10 @@ uint8_t script_run() {
                 uint8_t i;
                 for (i = 0; i < 4; i++)
                     data[i] = flash_readbyte(scriptdata_p++);
+                uint8_t cmd1 = data[0];
+                uint8_t cmd2 = data[1];
                 isp_transmit(data, sizeof (data));
+                isp_completeInstruction(cmd1, cmd2);
                 success = 1;
             }
                 break;
@@ -101,6 +243,13 @@ uint8_t script_run() {
                 break;
             case SCRIPT_CMD_FLASH:
             case SCRIPT_CMD_EEPROM:
+#ifdef UPDI
+            case SCRIPT_CMD_UPDI_FLASH:
+            case SCRIPT_CMD_UPDI_EEPROM:
+#endif
+#ifdef TPI
+            case SCRIPT_CMD_TPI_FLASH:
+#endif
             {
 
                 uint32_t address = (uint32_t) flash_readbyte(scriptdata_p++) << 24;
@@ -116,18 +265,125 @@ uint8_t script_run() {
                 uint16_t pagesize = (uint16_t) flash_readbyte(scriptdata_p++) << 8;
                 pagesize |= (uint16_t) flash_readbyte(scriptdata_p++);
 
-                if (cmd == SCRIPT_CMD_FLASH) {
-                    isp_writeFlash(scriptdata_p, address, length, pagesize);
-                    success = isp_verifyFlash(scriptdata_p, address, length);
-                } else {
-                    isp_writeEEPROM(scriptdata_p, address, length, pagesize);
-                    success = isp_verifyEEPROM(scriptdata_p, address, length);
+                switch (cmd) {
+                    case SCRIPT_CMD_FLASH:
+                        isp_writeFlash(scriptdata_p, address, length, pagesize);
+                        success = isp_verifyFlash(scriptdata_p, address, length);
+                        break;
+                    case SCRIPT_CMD_EEPROM:
+                        isp_writeEEPROM(scriptdata_p, address, length, pagesize);
+                        success = isp_verifyEEPROM(scriptdata_p, address, length);
+                        break;
+#ifdef UPDI
+                    case SCRIPT_CMD_UPDI_FLASH:
+                        success = updi_writeFlash(scriptdata_p, address, length, pagesize)
+                                && updi_verifyFlash(scriptdata_p, address, length);
+                        break;
+                    case SCRIPT_CMD_UPDI_EEPROM:
+                        success = updi_writeEEPROM(scriptdata_p, address, length, pagesize)
+                                && updi_verifyEEPROM(scriptdata_p, address, length);
+                        break;
+#endif
+#ifdef TPI
+                    case SCRIPT_CMD_TPI_FLASH:
+                        success = tpi_writeFlash(scriptdata_p, address, length)
+                                && tpi_verifyFlash(scriptdata_p, address, length);
+                        break;
+#endif
                 }
 
                 scriptdata_p += length;
             }
                 break;
 
+#ifdef UPDI
+            case SCRIPT_CMD_UPDI_CONNECT:
+                success = updi_connect();
+                break;
+
+            case SCRIPT_CMD_UPDI_DISCONNECT:
+                success = updi_disconnect();
+                break;
+
+            case SCRIPT_CMD_UPDI_ERASE:
+                success = updi_erase();
+                break;
+#endif
+
+#ifdef TPI
+            case SCRIPT_CMD_TPI_CONNECT:
+                success = tpi_connect();
+                break;
+
+            case SCRIPT_CMD_TPI_DISCONNECT:
+                success = tpi_disconnect();
+                break;
+
+            case SCRIPT_CMD_TPI_ERASE:
+                success = tpi_erase();
+                break;
+#endif
+
+            case SCRIPT_CMD_SERIAL:
+            {
+                uint8_t memtype = flash_readbyte(scriptdata_p++);
+
+                uint32_t address = (uint32_t) flash_readbyte(scriptdata_p++) << 24;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++) << 16;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++) << 8;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++);
+
+                uint8_t width = flash_readbyte(scriptdata_p++);
+                uint8_t flags = flash_readbyte(scriptdata_p++);
+
+                uint32_t startvalue = (uint32_t) flash_readbyte(scriptdata_p++) << 24;
+                startvalue |= (uint32_t) flash_readbyte(scriptdata_p++) << 16;
+                startvalue |= (uint32_t) flash_readbyte(scriptdata_p++) << 8;
+                startvalue |= (uint32_t) flash_readbyte(scriptdata_p++);
+
+                // a higher start value in the script starts a new number range
+                uint32_t serial = counter_readSerial();
+                if ((serial == 0xffffffff) || (serial < startvalue)) serial = startvalue;
+
+                uint8_t buffer[5];
+                uint8_t length = script_buildSerial(buffer, serial, width, flags);
+
+                success = isp_writeBytes(memtype, address, buffer, length);
+                if (success) counter_writeSerial(serial + 1);
+            }
+                break;
+
+            case SCRIPT_CMD_COPYBYTE:
+            {
+                uint8_t data[4];
+                uint8_t i;
+
+                for (i = 0; i < 4; i++)
+                    data[i] = flash_readbyte(scriptdata_p++);
+
+                uint8_t memtype = flash_readbyte(scriptdata_p++);
+
+                uint32_t address = (uint32_t) flash_readbyte(scriptdata_p++) << 24;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++) << 16;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++) << 8;
+                address |= (uint32_t) flash_readbyte(scriptdata_p++);
+
+                isp_transmit(data, sizeof (data));
+                success = isp_writeBytes(memtype, address, &data[3], 1);
+            }
+                break;
+
+#ifdef BENCHMARK
+            case SCRIPT_CMD_BENCHMARK:
+                success = bench_run();
+                break;
+#endif
+
+            case SCRIPT_CMD_SYNCCHECK:
+                isp_setSyncCheck(flash_readbyte(scriptdata_p++));
+                success = 1;
+                break;
+
             case SCRIPT_CMD_DECCOUNTER:
             {
                 uint16_t startvalue = (uint16_t) flash_readbyte(scriptdata_p++) << 8;
@@ -138,14 +394,298 @@ uint8_t script_run() {
                 break;
 
             case SCRIPT_CMD_END:
-                return 1;
+                return SCRIPT_RESULT_OK;
                 break;
         }
 
+        if (isp_getSyncError()) {
+            script_release();
+            return SCRIPT_RESULT_SYNCLOST;
+        }
+
         if (!success) {
-            isp_disconnect();
-            return 0;
+            script_release();
+            return SCRIPT_RESULT_ERROR;
+        }
+    }
+}
+
+#ifdef DRYRUN
+
+/**
+ * @brief Read big endian number from script memory
+ * @param mempointer Pointer to first byte in script memory
+ * @param bytes Number of bytes (1..4)
+ * @return Number read
+ */
+static uint32_t script_readNumber(uint32_t mempointer, uint8_t bytes) {
+
+    uint32_t value = 0;
+
+    while (bytes--) value = (value << 8) | flash_readbyte(mempointer++);
+
+    return value;
+}
+
+/**
+ * @brief Estimate duration of one ISP instruction
+ * @param sckoption Programming clock option
+ * @return Duration in microseconds
+ */
+static uint32_t script_instructionTime(uint8_t sckoption) {
+
+    // SPI clock divider, one byte takes divider microseconds with 8 MHz
+    static const uint8_t dividers[] PROGMEM = {4, 16, 64, 128};
+    uint8_t divider = pgm_read_byte(&dividers[sckoption & 0x03]);
+    if (sckoption & 0x04) divider >>= 1;
+
+    return 4 * divider + SCRIPT_DRYRUN_INSTRUCTION_US;
+}
+
+/**
+ * @brief Count target pages touched by given block
+ * @param address Target address
+ * @param length Length of data block
+ * @param pagesize Size of target page
+ * @return Number of pages
+ */
+static uint32_t script_pageCount(uint32_t address, uint32_t length, uint16_t pagesize) {
+
+    if (length == 0) return 0;
+    if (pagesize == 0) pagesize = 1;
+
+    return (address + length - 1) / pagesize - address / pagesize + 1;
+}
+
+/**
+ * @brief Walk the script without driving the target and report estimated
+ *        duration of every command and the total on USART
+ *
+ * Costs are modeled from the programming clock, byte and page counts and the
+ * delays of an unknown device (as used without device table entry). Page
+ * sizes are taken from the script; for known devices a real run uses the page
+ * sizes of the device table instead. EEPROM estimates assume that every byte
+ * differs; RDY/BSY polling and skipped EEPROM writes make real runs faster.
+ *
+ * @retval 0 Script is corrupted or contains an unknown command
+ * @retval 1 Estimation done
+ */
+uint8_t script_dryrun() {
+
+    DEFINE_DATAPOINTER;
+
+    uint8_t sckoption = ISP_SCKOPTION_SLOWEST;
+    uint32_t total = 0;
+
+    uart_init();
+    uart_puts_P(PSTR("\r\nScript dry run\r\n"));
+    uart_puts_P(PSTR("Unknown device: script page sizes, no polling (device table overrides page sizes)\r\n"));
+
+    uint8_t check;
+    while ((check = script_check()) == SCRIPT_CHECK_PENDING);
+    if (check != SCRIPT_CHECK_OK) {
+        uart_puts_P(PSTR("Script corrupted\r\n"));
+        return 0;
+    }
+
+    device_reset();
+    uint32_t delayflash = (uint32_t) device_current.delayflash * CLOCK_TICKER_FAST_US;
+    uint32_t delayeeprom = (uint32_t) device_current.delayeeprom * CLOCK_TICKER_FAST_US;
+    uint32_t delayerase = (uint32_t) device_current.delayerase * CLOCK_TICKER_FAST_US;
+    uint32_t delayfuse = (uint32_t) device_current.delayfuse * CLOCK_TICKER_FAST_US;
+
+    scriptdata_p += SCRIPT_HEADER_LENGTH;
+    uint32_t start = scriptdata_p;
+
+    while (1) {
+
+        uint32_t offset = scriptdata_p - start;
+        uint8_t cmd = flash_readbyte(scriptdata_p++);
+        uint32_t instruction = script_instructionTime(sckoption);
+        uint32_t time = 0;
+
+        switch (cmd) {
+
+            case SCRIPT_CMD_CONNECT:
+                sckoption = flash_readbyte(scriptdata_p++);
+                // sync and signature
+                time = SCRIPT_DRYRUN_CONNECT_US + 4 * script_instructionTime(sckoption);
+                break;
+
+            case SCRIPT_CMD_DISCONNECT:
+#ifdef UPDI
+            case SCRIPT_CMD_UPDI_DISCONNECT:
+#endif
+#ifdef TPI
+            case SCRIPT_CMD_TPI_DISCONNECT:
+#endif
+                break;
+
+#ifdef BENCHMARK
+            case SCRIPT_CMD_BENCHMARK:
+            {
+                // reference read, reads with every option (without
+                // reconnects after failed options), page write and report
+                uint8_t option;
+
+                time = (uint32_t) ISP_PAGEBUFFER_SIZE * script_instructionTime(ISP_SCKOPTION_SLOWEST);
+                for (option = 0; option < BENCH_SCKOPTIONS; option++)
+                    time += (uint32_t) BENCH_RUNS * ISP_PAGEBUFFER_SIZE * script_instructionTime(option);
+                time += (ISP_PAGEBUFFER_SIZE + 2) * instruction + delayflash + SCRIPT_DRYRUN_BENCH_REPORT_US;
+            }
+                break;
+#endif
+
+            case SCRIPT_CMD_WAIT:
+                time = (uint32_t) flash_readbyte(scriptdata_p++) * CLOCK_TICKER_FAST_10MS * CLOCK_TICKER_FAST_US;
+                break;
+
+            case SCRIPT_CMD_SPI_SEND:
+            {
+                uint8_t cmd1 = flash_readbyte(scriptdata_p);
+                uint8_t cmd2 = flash_readbyte(scriptdata_p + 1);
+                scriptdata_p += 4;
+
+                time = instruction;
+                if (cmd1 == ISP_CMD_WRITE) {
+                    if (cmd2 == ISP_CMD_WRITE_CHIP_ERASE) time += delayerase;
+                    else if ((cmd2 == ISP_CMD_WRITE_LOCK_BITS) || (cmd2 == ISP_CMD_WRITE_FUSE_BITS)
+                            || (cmd2 == ISP_CMD_WRITE_FUSE_HIGH_BITS) || (cmd2 == ISP_CMD_WRITE_EXTENDED_FUSE_BITS)) time += delayfuse;
+                }
+            }
+                break;
+
+            case SCRIPT_CMD_SPI_VERIFY:
+                scriptdata_p += 5;
+                time = instruction;
+                break;
+
+            case SCRIPT_CMD_FLASH:
+            case SCRIPT_CMD_EEPROM:
+#ifdef UPDI
+            case SCRIPT_CMD_UPDI_FLASH:
+            case SCRIPT_CMD_UPDI_EEPROM:
+#endif
+#ifdef TPI
+            case SCRIPT_CMD_TPI_FLASH:
+#endif
+            {
+                uint32_t address = script_readNumber(scriptdata_p, 4);
+                uint32_t length = script_readNumber(scriptdata_p + 4, 4);
+                uint16_t pagesize = script_readNumber(scriptdata_p + 8, 2);
+                uint32_t pages = script_pageCount(address, length, pagesize);
+                scriptdata_p += 10 + length;
+
+                switch (cmd) {
+                    case SCRIPT_CMD_FLASH:
+                        // load, extended address and commit per page, verify
+                        time = (2 * length + 3 * pages) * instruction + pages * delayflash;
+                        break;
+                    case SCRIPT_CMD_EEPROM:
+                        if (pagesize <= 1) {
+                            // read, write and verify per byte
+                            time = length * (3 * instruction + delayeeprom);
+                        } else {
+                            // compare, load and verify per byte, commit per page
+                            time = (3 * length + pages) * instruction + pages * delayeeprom;
+                        }
+                        break;
+#ifdef UPDI
+                    case SCRIPT_CMD_UPDI_FLASH:
+                    case SCRIPT_CMD_UPDI_EEPROM:
+                        time = 2 * length * SCRIPT_DRYRUN_UPDI_BYTE_US + pages * SCRIPT_DRYRUN_UPDI_PAGE_US;
+                        break;
+#endif
+#ifdef TPI
+                    case SCRIPT_CMD_TPI_FLASH:
+                        time = 2 * length * SCRIPT_DRYRUN_TPI_BYTE_US + ((length + 1) / 2) * SCRIPT_DRYRUN_TPI_WORD_US;
+                        break;
+#endif
+                }
+            }
+                break;
+
+#ifdef UPDI
+            case SCRIPT_CMD_UPDI_CONNECT:
+                time = SCRIPT_DRYRUN_UPDI_CONNECT_US;
+                break;
+
+            case SCRIPT_CMD_UPDI_ERASE:
+                time = SCRIPT_DRYRUN_UPDI_ERASE_US;
+                break;
+#endif
+
+#ifdef TPI
+            case SCRIPT_CMD_TPI_CONNECT:
+                time = SCRIPT_DRYRUN_TPI_CONNECT_US;
+                break;
+
+            case SCRIPT_CMD_TPI_ERASE:
+                time = SCRIPT_DRYRUN_TPI_ERASE_US;
+                break;
+#endif
+
+            case SCRIPT_CMD_SERIAL:
+            case SCRIPT_CMD_COPYBYTE:
+            {
+                uint8_t length = 1;
+
+                if (cmd == SCRIPT_CMD_COPYBYTE) {
+                    scriptdata_p += 4;
+                    time = instruction;
+                }
+
+                uint8_t memtype = flash_readbyte(scriptdata_p);
+                scriptdata_p += 5;
+
+                if (cmd == SCRIPT_CMD_SERIAL) {
+                    length = flash_readbyte(scriptdata_p);
+                    if (length < 1) length = 1;
+                    if (length > 4) length = 4;
+                    if (flash_readbyte(scriptdata_p + 1) & SCRIPT_SERIAL_CRC8) length++;
+                    scriptdata_p += 6;
+                    // three redundant copies of serial and its complement
+                    time = 3 * 2 * sizeof (uint32_t) * SCRIPT_DRYRUN_INTERNAL_EEPROM_US;
+                }
+
+                if (memtype == ISP_MEMTYPE_EEPROM) time += length * (3 * instruction + delayeeprom);
+                else time += (2 * length + 2) * instruction + delayflash;
+            }
+                break;
+
+            case SCRIPT_CMD_SYNCCHECK:
+                scriptdata_p++;
+                break;
+
+            case SCRIPT_CMD_DECCOUNTER:
+                scriptdata_p += 2;
+                // three redundant copies of counter and its complement
+                time = 3 * 2 * sizeof (uint16_t) * SCRIPT_DRYRUN_INTERNAL_EEPROM_US;
+                break;
+
+            case SCRIPT_CMD_END:
+                uart_puts_P(PSTR("Total: "));
+                uart_putDecimal(total);
+                uart_puts_P(PSTR(" us\r\n"));
+                return 1;
+
+            default:
+                uart_puts_P(PSTR("Unknown command "));
+                uart_putDecimal(cmd);
+                uart_puts_P(PSTR("\r\n"));
+                return 0;
         }
+
+        total += time;
+
+        uart_puts_P(PSTR("@"));
+        uart_putDecimal(offset);
+        uart_puts_P(PSTR(" cmd "));
+        uart_putDecimal(cmd);
+        uart_puts_P(PSTR(": "));
+        uart_putDecimal(time);
+        uart_puts_P(PSTR(" us\r\n"));
     }
 }
 
+#endif
@@ -37,9 +37,52 @@
 #define SCRIPT_CMD_WAIT         0x06    ///< Command: Wait x*10ms
 #define SCRIPT_CMD_DECCOUNTER   0x07    ///< Command: Decrement programming counter
 #define SCRIPT_CMD_EEPROM       0x08    ///< Command: Write eeprom data block
+#define SCRIPT_CMD_SYNCCHECK    0x09    ///< Command: Enable/disable echo check of ISP instructions
+#define SCRIPT_CMD_SERIAL       0x0A    ///< Command: Write next serial number
+#define SCRIPT_CMD_COPYBYTE     0x0B    ///< Command: Copy byte read by ISP instruction to target memory
+#define SCRIPT_CMD_BENCHMARK    0x0C    ///< Command: Run SPI throughput benchmark
+#define SCRIPT_CMD_UPDI_CONNECT 0x10    ///< Command: UPDI connect
+#define SCRIPT_CMD_UPDI_DISCONNECT 0x11 ///< Command: UPDI disconnect
+#define SCRIPT_CMD_UPDI_ERASE   0x12    ///< Command: UPDI chip erase
+#define SCRIPT_CMD_UPDI_FLASH   0x13    ///< Command: UPDI flash data block
+#define SCRIPT_CMD_UPDI_EEPROM  0x14    ///< Command: UPDI eeprom data block
+#define SCRIPT_CMD_TPI_CONNECT  0x18    ///< Command: TPI connect
+#define SCRIPT_CMD_TPI_DISCONNECT 0x19  ///< Command: TPI disconnect
+#define SCRIPT_CMD_TPI_ERASE    0x1A    ///< Command: TPI chip erase
+#define SCRIPT_CMD_TPI_FLASH    0x1B    ///< Command: TPI flash data block
 #define SCRIPT_CMD_END          0xff    ///< Command: End of script
 
+#define SCRIPT_SERIAL_BIGENDIAN 0x01    ///< Serial flag: Most significant byte first
+#define SCRIPT_SERIAL_CRC8      0x02    ///< Serial flag: Append CRC8 (Dallas/Maxim)
+
+#define SCRIPT_RESULT_ERROR     0x00    ///< Result: Error occured
+#define SCRIPT_RESULT_OK        0x01    ///< Result: Everything okay
+#define SCRIPT_RESULT_SYNCLOST  0x02    ///< Result: Lost sync with target
+
+#define SCRIPT_HEADER_LENGTH    8       ///< Script header: length (4 bytes), CRC32 (4 bytes)
+#define SCRIPT_CHECK_CHUNK      64      ///< Script bytes checked per call of script_check
+
+#define SCRIPT_CHECK_PENDING    0x00    ///< Check: CRC calculation in progress
+#define SCRIPT_CHECK_OK         0x01    ///< Check: Script data is intact
+#define SCRIPT_CHECK_BAD        0x02    ///< Check: Script data is corrupted
+
+// dry run cost model (microseconds, 8 MHz)
+#define SCRIPT_DRYRUN_INSTRUCTION_US 8      ///< Software overhead per ISP instruction
+#define SCRIPT_DRYRUN_CONNECT_US 35000      ///< Reset pulse and wait of one sync attempt
+#define SCRIPT_DRYRUN_INTERNAL_EEPROM_US 3400 ///< Write of one byte of programmer EEPROM
+#define SCRIPT_DRYRUN_BENCH_REPORT_US 80000 ///< Benchmark report output at 38400 baud
+#define SCRIPT_DRYRUN_UPDI_BYTE_US 24       ///< One UPDI frame at 500 kBaud (8E2)
+#define SCRIPT_DRYRUN_UPDI_PAGE_US 2500     ///< UPDI page overhead and page write
+#define SCRIPT_DRYRUN_UPDI_CONNECT_US 50000 ///< UPDI enable, key and reset
+#define SCRIPT_DRYRUN_UPDI_ERASE_US 20000   ///< UPDI chip erase
+#define SCRIPT_DRYRUN_TPI_BYTE_US 80        ///< Two TPI frames per byte incl. guard time
+#define SCRIPT_DRYRUN_TPI_WORD_US 2000      ///< TPI word write incl. NVMBSY polling
+#define SCRIPT_DRYRUN_TPI_CONNECT_US 2000   ///< TPI enable and NVM key
+#define SCRIPT_DRYRUN_TPI_ERASE_US 10000    ///< TPI chip erase
+
+uint8_t script_check();
 uint8_t script_run();
+uint8_t script_dryrun();
 
 #endif
 
@@ -0,0 +1,321 @@
+/**
+ * @file tpi.c
+ *
+ * @brief This file contains TPI programming functions
+ *
+ * TPI is bit-banged on the ISP lines: SCK drives TPICLK, MOSI drives TPIDATA
+ * through a resistor and MISO reads TPIDATA. RST is held low while connected.
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "clock.h"
+#include "hal.h"
+#include "isp.h"
+#include "tpi.h"
+
+#ifdef TPI
+
+/**
+ * @brief Maximum number of bits to wait for start bit of a received frame
+ */
+#define TPI_START_TIMEOUT 192
+
+/**
+ * @brief Half period of TPICLK
+ */
+#define TPI_DELAY() __asm__ __volatile__ ("nop\n\tnop\n\tnop\n\tnop")
+
+/**
+ * @brief Transfer one bit
+ * @param bit Bit to send (1 to release data line for receiving)
+ * @return Bit read from data line
+ */
+static uint8_t tpi_bit(uint8_t bit) {
+
+    if (bit) ISP_OUT |= (1 << ISP_MOSI);
+    else ISP_OUT &= ~(1 << ISP_MOSI);
+
+    TPI_DELAY();
+    ISP_OUT |= (1 << ISP_SCK);
+    TPI_DELAY();
+    bit = (ISP_IN >> ISP_MISO) & 1;
+    ISP_OUT &= ~(1 << ISP_SCK);
+
+    return bit;
+}
+
+/**
+ * @brief Send one frame (start bit, 8 data bits, even parity, 2 stop bits)
+ * @param data Byte to send
+ */
+static void tpi_send(uint8_t data) {
+
+    uint8_t parity = 0;
+    uint8_t i;
+
+    tpi_bit(0);
+    for (i = 0; i < 8; i++) {
+        tpi_bit(data & 1);
+        parity ^= data & 1;
+        data >>= 1;
+    }
+    tpi_bit(parity);
+    tpi_bit(1);
+    tpi_bit(1);
+}
+
+/**
+ * @brief Receive one frame
+ * @param data Pointer to store received byte
+ * @retval 0 No start bit, parity or stop bit error
+ * @retval 1 Byte received
+ */
+static uint8_t tpi_receive(uint8_t * data) {
+
+    uint8_t timeout = TPI_START_TIMEOUT;
+    uint8_t parity = 0;
+    uint8_t value = 0;
+    uint8_t i;
+
+    // skip guard time and wait for start bit
+    while (tpi_bit(1)) {
+        if (--timeout == 0) return 0;
+    }
+
+    for (i = 0; i < 8; i++) {
+        uint8_t bit = tpi_bit(1);
+        value = (value >> 1) | (bit << 7);
+        parity ^= bit;
+    }
+
+    *data = value;
+
+    if (tpi_bit(1) != parity) return 0;
+    return tpi_bit(1) & tpi_bit(1);
+}
+
+/**
+ * @brief Load control/status register
+ * @param reg Register address
+ * @param data Pointer to store register value
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t tpi_sldcs(uint8_t reg, uint8_t * data) {
+    tpi_send(TPI_CMD_SLDCS | reg);
+    return tpi_receive(data);
+}
+
+/**
+ * @brief Store control/status register
+ * @param reg Register address
+ * @param data Value to store
+ */
+static void tpi_sstcs(uint8_t reg, uint8_t data) {
+    tpi_send(TPI_CMD_SSTCS | reg);
+    tpi_send(data);
+}
+
+/**
+ * @brief Write I/O register
+ * @param reg I/O address
+ * @param data Value to write
+ */
+static void tpi_sout(uint8_t reg, uint8_t data) {
+    tpi_send(TPI_CMD_SOUT | (reg & 0x0f) | ((reg & 0x30) << 1));
+    tpi_send(data);
+}
+
+/**
+ * @brief Read I/O register
+ * @param reg I/O address
+ * @param data Pointer to store register value
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t tpi_sin(uint8_t reg, uint8_t * data) {
+    tpi_send(TPI_CMD_SIN | (reg & 0x0f) | ((reg & 0x30) << 1));
+    return tpi_receive(data);
+}
+
+/**
+ * @brief Set pointer register
+ * @param address Data space address
+ */
+static void tpi_setPointer(uint16_t address) {
+    tpi_send(TPI_CMD_SSTPR | 0);
+    tpi_send(address);
+    tpi_send(TPI_CMD_SSTPR | 1);
+    tpi_send(address >> 8);
+}
+
+/**
+ * @brief Wait until NVM controller is ready
+ * @retval 0 Timeout or error occured
+ * @retval 1 NVM controller is ready
+ */
+static uint8_t tpi_waitNVM() {
+
+    uint8_t ticker = clock_getTickerSlow();
+    uint8_t status;
+
+    do {
+        if (!tpi_sin(TPI_IO_NVMCSR, &status)) return 0;
+        if (!(status & TPI_NVMCSR_BSY)) return 1;
+    } while (clock_getTickerSlowDiff(ticker) < CLOCK_TICKER_SLOW_100MS);
+
+    return 0;
+}
+
+/**
+ * @brief Connect to TPI target and enable NVM programming
+ * @retval 0 Error occured
+ * @retval 1 Connected successfully to target
+ */
+uint8_t tpi_connect() {
+
+    static const uint8_t key[] PROGMEM = {0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12};
+    uint8_t data;
+    uint8_t i;
+
+    // SPI must not drive SCK/MOSI
+    SPCR = 0;
+
+    // hold reset low, data line idles high
+    ISP_OUT &= ~((1 << ISP_RST) | (1 << ISP_SCK));
+    ISP_OUT |= (1 << ISP_MOSI);
+    ISP_DDR |= (1 << ISP_RST) | (1 << ISP_SCK) | (1 << ISP_MOSI);
+
+    clock_delayFast(CLOCK_TICKER_FAST_1MS);
+
+    // at least 16 idle bits to enable TPI
+    for (i = 0; i < 32; i++) tpi_bit(1);
+
+    tpi_sstcs(TPI_REG_TPIPCR, TPI_TPIPCR_GT_2BITS);
+    if (!tpi_sldcs(TPI_REG_TPIIR, &data) || (data != TPI_TPIIR_VALUE)) return 0;
+
+    tpi_send(TPI_CMD_SKEY);
+    for (i = 0; i < sizeof (key); i++) tpi_send(pgm_read_byte(&key[i]));
+
+    uint8_t ticker = clock_getTickerSlow();
+    do {
+        if (tpi_sldcs(TPI_REG_TPISR, &data) && (data & TPI_TPISR_NVMEN)) return 1;
+    } while (clock_getTickerSlowDiff(ticker) < CLOCK_TICKER_SLOW_100MS);
+
+    return 0;
+}
+
+/**
+ * @brief Disable NVM programming and disconnect from TPI target
+ * @retval 1 Everything okay
+ */
+uint8_t tpi_disconnect() {
+
+    tpi_sstcs(TPI_REG_TPISR, 0);
+
+    // release reset, then release all lines
+    ISP_OUT |= (1 << ISP_RST);
+    clock_delayFast(CLOCK_TICKER_FAST_1MS);
+
+    return isp_disconnect();
+}
+
+/**
+ * @brief Erase complete TPI target
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+uint8_t tpi_erase() {
+
+    if (!tpi_waitNVM()) return 0;
+
+    tpi_sout(TPI_IO_NVMCMD, TPI_NVMCMD_CHIP_ERASE);
+    tpi_setPointer(TPI_FLASH_START | 1);
+    tpi_send(TPI_CMD_SST);
+    tpi_send(0xff);
+
+    return tpi_waitNVM();
+}
+
+/**
+ * @brief Transfer given memory block to TPI target flash
+ *
+ * The pointer is set once per block, words are streamed with SST+ and
+ * NVMBSY is polled after each word. Missing bytes of the first/last word
+ * are padded with 0xff.
+ *
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Target flash address
+ * @param length Length of data block
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+uint8_t tpi_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length) {
+
+    uint16_t start = address & ~1;
+    uint16_t end = (address + length + 1) & ~1;
+
+    if (!tpi_waitNVM()) return 0;
+
+    tpi_sout(TPI_IO_NVMCMD, TPI_NVMCMD_WORD_WRITE);
+    tpi_setPointer(TPI_FLASH_START + start);
+
+    for (; start < end; start++) {
+
+        uint8_t data = 0xff;
+        if ((start >= address) && (start < address + length)) data = flash_readbyte(mempointer++);
+
+        tpi_send(TPI_CMD_SST_INC);
+        tpi_send(data);
+
+        if ((start & 1) && !tpi_waitNVM()) return 0;
+    }
+
+    tpi_sout(TPI_IO_NVMCMD, TPI_NVMCMD_NO_OPERATION);
+
+    return 1;
+}
+
+/**
+ * @brief Read data from TPI target and verify its content with given flash block
+ * @param mempointer Pointer to data block to verify with
+ * @param address Target flash address
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+uint8_t tpi_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length) {
+
+    uint8_t data;
+
+    tpi_setPointer(TPI_FLASH_START + address);
+
+    while (length > 0) {
+        tpi_send(TPI_CMD_SLD_INC);
+        if (!tpi_receive(&data)) return 0;
+        if (data != flash_readbyte(mempointer++)) return 0;
+        length--;
+    }
+
+    return 1;
+}
+
+#endif
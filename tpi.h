@@ -0,0 +1,61 @@
+/**
+ * @file tpi.h
+ *
+ * @brief This file contains definitions for TPI programming functions
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef _TPI_
+#define _TPI_
+
+#define TPI_CMD_SLD 0x20
+#define TPI_CMD_SLD_INC 0x24
+#define TPI_CMD_SST 0x60
+#define TPI_CMD_SST_INC 0x64
+#define TPI_CMD_SSTPR 0x68
+#define TPI_CMD_SIN 0x10
+#define TPI_CMD_SOUT 0x90
+#define TPI_CMD_SLDCS 0x80
+#define TPI_CMD_SSTCS 0xC0
+#define TPI_CMD_SKEY 0xE0
+
+#define TPI_REG_TPISR 0x00
+#define TPI_REG_TPIPCR 0x02
+#define TPI_REG_TPIIR 0x0F
+
+#define TPI_TPISR_NVMEN 0x02
+#define TPI_TPIPCR_GT_2BITS 0x06
+#define TPI_TPIIR_VALUE 0x80
+
+#define TPI_IO_NVMCSR 0x32
+#define TPI_IO_NVMCMD 0x33
+#define TPI_NVMCSR_BSY 0x80
+
+#define TPI_NVMCMD_NO_OPERATION 0x00
+#define TPI_NVMCMD_CHIP_ERASE 0x10
+#define TPI_NVMCMD_WORD_WRITE 0x1D
+
+#define TPI_FLASH_START 0x4000
+
+uint8_t tpi_connect();
+uint8_t tpi_disconnect();
+uint8_t tpi_erase();
+uint8_t tpi_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length);
+uint8_t tpi_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length);
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file uart.c
+ *
+ * @brief This file contains report output functions (USART transmit only)
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "hal.h"
+#include "uart.h"
+
+#if defined(USART_UDR) && (defined(BENCHMARK) || defined(DRYRUN))
+
+/**
+ * @brief Initialize USART for report output (8N1)
+ */
+void uart_init() {
+    USART_UCSRB = 0;
+    USART_UBRR = UART_UBRR;
+    USART_UCSRA = (1 << USART_U2X);
+    USART_UCSRC = USART_UCSRC_8N1;
+    USART_UCSRB = (1 << USART_TXEN);
+}
+
+/**
+ * @brief Transmit one character
+ * @param c Character to transmit
+ */
+void uart_putc(char c) {
+    while (!(USART_UCSRA & (1 << USART_UDRE)));
+    USART_UDR = c;
+}
+
+/**
+ * @brief Transmit string stored in program memory
+ * @param s Pointer to string
+ */
+void uart_puts_P(const char * s) {
+    char c;
+    while ((c = pgm_read_byte(s++))) uart_putc(c);
+}
+
+/**
+ * @brief Transmit given value as decimal number
+ * @param value Value to transmit
+ */
+void uart_putDecimal(uint32_t value) {
+
+    char buffer[10];
+    uint8_t i = 0;
+
+    do {
+        buffer[i++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    while (i) uart_putc(buffer[--i]);
+}
+
+#endif
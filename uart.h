@@ -0,0 +1,34 @@
+/**
+ * @file uart.h
+ *
+ * @brief This file contains definitions for report output functions
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef _UART_
+#define _UART_
+
+// 8 MHz, double speed: 38461 baud
+#define UART_UBRR 25
+
+void uart_init();
+void uart_putc(char c);
+void uart_puts_P(const char * s);
+void uart_putDecimal(uint32_t value);
+
+#endif
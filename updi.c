@@ -0,0 +1,613 @@
+/**
+ * @file updi.c
+ *
+ * @brief This file contains UPDI programming functions
+ *
+ * The UPDI line of the target is connected to RXD and (through a resistor)
+ * to TXD of the USART defined in hal.h. Every transmitted byte is therefore
+ * received as echo, too.
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "clock.h"
+#include "hal.h"
+#include "isp.h"
+#include "updi.h"
+
+#ifdef UPDI
+
+#ifndef USART_UDR
+#error "UPDI not supported by HAL"
+#endif
+
+/**
+ * @brief NVM controller version of connected target (from SIB)
+ */
+static uint8_t updi_nvmversion;
+
+/**
+ * @brief Start of flash in data space of connected target
+ */
+static uint32_t updi_flashstart;
+
+/**
+ * @brief Use 24 bit addresses
+ */
+static uint8_t updi_address24;
+
+/**
+ * @brief UPDI session is open (USART enabled and driving the UPDI line)
+ */
+static uint8_t updi_connected = 0;
+
+/**
+ * @brief NVM programming mode is entered
+ */
+static uint8_t updi_progmode = 0;
+
+/**
+ * @brief Initialize USART for UPDI (8 data bits, even parity, 2 stop bits)
+ * @param ubrr Baud rate register value
+ */
+static void updi_setBaudrate(uint8_t ubrr) {
+    USART_UCSRB = 0;
+    USART_UBRR = ubrr;
+    USART_UCSRA = (1 << USART_U2X);
+    USART_UCSRC = USART_UCSRC_8E2;
+    USART_UCSRB = (1 << USART_RXEN) | (1 << USART_TXEN);
+}
+
+/**
+ * @brief Send break (line low for more than 24.6ms)
+ */
+static void updi_break() {
+
+    uint8_t ucsrb = USART_UCSRB;
+
+    USART_UCSRB = 0;
+    USART_OUT &= ~(1 << USART_TXD);
+    USART_DDR |= (1 << USART_TXD);
+    clock_delayFast(CLOCK_TICKER_FAST_25MS);
+    USART_OUT |= (1 << USART_TXD);
+    clock_delayFast(CLOCK_TICKER_FAST_1MS);
+
+    USART_UCSRB = ucsrb;
+}
+
+/**
+ * @brief Receive one byte from UPDI
+ * @param data Pointer to store received byte
+ * @retval 0 Timeout or frame/parity error
+ * @retval 1 Byte received
+ */
+static uint8_t updi_receive(uint8_t * data) {
+
+    uint8_t ticker = clock_getTickerFast();
+
+    while (!(USART_UCSRA & (1 << USART_RXC))) {
+        if (clock_getTickerFastDiff(ticker) > UPDI_TIMEOUT) return 0;
+    }
+
+    uint8_t error = USART_UCSRA & ((1 << USART_FE) | (1 << USART_UPE));
+    *data = USART_UDR;
+
+    return !error;
+}
+
+/**
+ * @brief Send one byte over UPDI and read back its echo
+ * @param data Byte to send
+ * @retval 0 Echo missing or wrong
+ * @retval 1 Byte sent
+ */
+static uint8_t updi_send(uint8_t data) {
+
+    uint8_t echo;
+
+    while (!(USART_UCSRA & (1 << USART_UDRE)));
+    USART_UDR = data;
+
+    return updi_receive(&echo) && (echo == data);
+}
+
+/**
+ * @brief Receive acknowledge from UPDI
+ * @retval 0 No acknowledge received
+ * @retval 1 Acknowledge received
+ */
+static uint8_t updi_receiveAck() {
+    uint8_t data;
+    return updi_receive(&data) && (data == UPDI_ACK);
+}
+
+/**
+ * @brief Send address with the size used for connected target
+ * @param address Address to send
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_sendAddress(uint32_t address) {
+    if (!updi_send(address) || !updi_send(address >> 8)) return 0;
+    if (updi_address24) return updi_send(address >> 16);
+    return 1;
+}
+
+/**
+ * @brief Get address size bits of LDS/STS/ST ptr instructions
+ * @return Address size bits
+ */
+static uint8_t updi_addressSize() {
+    return updi_address24 ? UPDI_ADDRESS_24 : UPDI_ADDRESS_16;
+}
+
+/**
+ * @brief Load control/status register
+ * @param reg Register address
+ * @param data Pointer to store register value
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_ldcs(uint8_t reg, uint8_t * data) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_LDCS | reg) && updi_receive(data);
+}
+
+/**
+ * @brief Store control/status register
+ * @param reg Register address
+ * @param data Value to store
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_stcs(uint8_t reg, uint8_t data) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_STCS | reg) && updi_send(data);
+}
+
+/**
+ * @brief Load byte from data space
+ * @param address Data space address
+ * @param data Pointer to store read byte
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_lds(uint32_t address, uint8_t * data) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_LDS | updi_addressSize() | UPDI_DATA_8)
+            && updi_sendAddress(address) && updi_receive(data);
+}
+
+/**
+ * @brief Store byte into data space
+ * @param address Data space address
+ * @param data Byte to store
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_sts(uint32_t address, uint8_t data) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_STS | updi_addressSize() | UPDI_DATA_8)
+            && updi_sendAddress(address) && updi_receiveAck()
+            && updi_send(data) && updi_receiveAck();
+}
+
+/**
+ * @brief Set pointer register
+ * @param address Data space address
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_setPointer(uint32_t address) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_ST | UPDI_PTR_ADDRESS | (updi_address24 ? UPDI_DATA_24 : UPDI_DATA_16))
+            && updi_sendAddress(address) && updi_receiveAck();
+}
+
+/**
+ * @brief Repeat next instruction
+ * @param count Number of executions (1..256)
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_repeat(uint16_t count) {
+    return updi_send(UPDI_SYNCH) && updi_send(UPDI_REPEAT | UPDI_DATA_8) && updi_send(count - 1);
+}
+
+/**
+ * @brief Send 64 bit key
+ * @param key Key string in program memory (sent in reversed order)
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_key(const char * key) {
+
+    uint8_t i = 8;
+
+    if (!updi_send(UPDI_SYNCH) || !updi_send(UPDI_KEY | UPDI_KEY_64)) return 0;
+    while (i--) {
+        if (!updi_send(pgm_read_byte(&key[i]))) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Apply and release system reset
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_reset() {
+    return updi_stcs(UPDI_ASI_RESET_REQ, UPDI_RESET_REQ_VALUE) && updi_stcs(UPDI_ASI_RESET_REQ, 0);
+}
+
+/**
+ * @brief Wait until given bits of system status match given value
+ * @param mask Bits to check
+ * @param value Value to wait for
+ * @retval 0 Timeout or error occured
+ * @retval 1 Status reached
+ */
+static uint8_t updi_waitSystemStatus(uint8_t mask, uint8_t value) {
+
+    uint8_t ticker = clock_getTickerSlow();
+    uint8_t status;
+
+    do {
+        if (!updi_ldcs(UPDI_ASI_SYS_STATUS, &status)) return 0;
+        if ((status & mask) == value) return 1;
+    } while (clock_getTickerSlowDiff(ticker) < CLOCK_TICKER_SLOW_500MS);
+
+    return 0;
+}
+
+/**
+ * @brief Wait until NVM controller is ready
+ * @retval 0 Timeout or error occured
+ * @retval 1 NVM controller is ready
+ */
+static uint8_t updi_waitNVM() {
+
+    uint8_t ticker = clock_getTickerSlow();
+    uint8_t status;
+
+    do {
+        if (!updi_lds(UPDI_NVMCTRL_STATUS, &status)) return 0;
+        if (!(status & UPDI_NVMCTRL_STATUS_BUSY)) return 1;
+        clock_yield();
+    } while (clock_getTickerSlowDiff(ticker) < CLOCK_TICKER_SLOW_500MS);
+
+    return 0;
+}
+
+/**
+ * @brief Execute NVM controller command
+ * @param cmd NVM command
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_nvmCommand(uint8_t cmd) {
+    return updi_sts(UPDI_NVMCTRL_CTRLA, cmd);
+}
+
+/**
+ * @brief Initialize UPDI data link and check connection
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_initLink() {
+    uint8_t status;
+    return updi_stcs(UPDI_CS_CTRLB, UPDI_CTRLB_CCDETDIS) && updi_stcs(UPDI_CS_CTRLA, UPDI_CTRLA_IBDLY)
+            && updi_ldcs(UPDI_CS_STATUSA, &status) && (status != 0);
+}
+
+/**
+ * @brief Enter NVM programming mode
+ * @retval 0 Error occured (e.g. device is locked)
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_enterProgmode() {
+
+    static const char key[] PROGMEM = "NVMProg ";
+    uint8_t status;
+
+    if (!updi_key(key)) return 0;
+    if (!updi_ldcs(UPDI_ASI_KEY_STATUS, &status) || !(status & UPDI_KEY_STATUS_NVMPROG)) return 0;
+    if (!updi_reset()) return 0;
+
+    return updi_waitSystemStatus(UPDI_SYS_STATUS_NVMPROG | UPDI_SYS_STATUS_LOCKSTATUS, UPDI_SYS_STATUS_NVMPROG);
+}
+
+/**
+ * @brief Enter NVM programming mode if not done yet
+ * @retval 0 Error occured (e.g. device is locked)
+ * @retval 1 Device is in NVM programming mode
+ */
+static uint8_t updi_requireProgmode() {
+    if (!updi_progmode) updi_progmode = updi_enterProgmode();
+    return updi_progmode;
+}
+
+/**
+ * @brief Connect to UPDI target
+ *
+ * Only the link is set up and the SIB is read, so a locked device connects
+ * too and can be unlocked by updi_erase(). NVM programming mode is entered
+ * by the first erase, write or verify.
+ *
+ * @retval 0 Error occured
+ * @retval 1 Connected successfully to target
+ */
+uint8_t updi_connect() {
+
+    uint8_t sib[UPDI_SIB_LENGTH];
+    uint8_t i;
+
+    USART_OUT |= (1 << USART_TXD);
+    updi_connected = 1;
+    updi_progmode = 0;
+    updi_address24 = 0;
+    updi_setBaudrate(UPDI_UBRR_INIT);
+
+    // enable UPDI with a short break, reset it with a double break if needed
+    updi_break();
+    if (!updi_initLink()) {
+        updi_break();
+        updi_break();
+        if (!updi_initLink()) return 0;
+    }
+
+    // read system information block
+    if (!updi_send(UPDI_SYNCH) || !updi_send(UPDI_KEY | UPDI_KEY_SIB)) return 0;
+    for (i = 0; i < sizeof (sib); i++) {
+        if (!updi_receive(&sib[i])) return 0;
+    }
+
+    // "tinyAVR P:0D:0-3..." / "megaAVR P:0..." / "AVR     P:2..."
+    updi_nvmversion = sib[10] - '0';
+    if (updi_nvmversion == 0) {
+        updi_flashstart = (sib[0] == 't') ? 0x8000 : 0x4000;
+    } else if (updi_nvmversion == 2) {
+        updi_flashstart = 0x800000;
+        updi_address24 = 1;
+    } else {
+        return 0;
+    }
+
+    // speed up UPDI clock and switch to fast baudrate
+    if (!updi_stcs(UPDI_ASI_CTRLA, UPDI_ASI_CTRLA_CLK16M)) return 0;
+    updi_setBaudrate(UPDI_UBRR_FAST);
+
+    return 1;
+}
+
+/**
+ * @brief Leave programming mode and disconnect from UPDI target
+ *
+ * Does nothing if no UPDI session is open, so it can be used on error paths.
+ *
+ * @retval 1 Everything okay
+ * @retval 0 Error occured
+ */
+uint8_t updi_disconnect() {
+
+    if (!updi_connected) return 1;
+
+    uint8_t success = updi_reset() && updi_stcs(UPDI_CS_CTRLB, UPDI_CTRLB_UPDIDIS | UPDI_CTRLB_CCDETDIS);
+
+    // release line
+    USART_UCSRB = 0;
+    USART_DDR &= ~(1 << USART_TXD);
+    USART_OUT &= ~(1 << USART_TXD);
+
+    updi_connected = 0;
+    updi_progmode = 0;
+
+    return success;
+}
+
+/**
+ * @brief Erase complete UPDI target (also unlocks it) and enter programming mode
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+uint8_t updi_erase() {
+
+    static const char key[] PROGMEM = "NVMErase";
+    uint8_t status;
+
+    if (!updi_key(key)) return 0;
+    if (!updi_ldcs(UPDI_ASI_KEY_STATUS, &status) || !(status & UPDI_KEY_STATUS_CHIPERASE)) return 0;
+    if (!updi_reset()) return 0;
+    if (!updi_waitSystemStatus(UPDI_SYS_STATUS_LOCKSTATUS, 0)) return 0;
+
+    updi_progmode = updi_enterProgmode();
+    return updi_progmode;
+}
+
+/**
+ * @brief Write data block with one burst (REPEAT and ST *ptr++)
+ *
+ * On NVM controller v0 the block goes to the page buffer, so response
+ * signatures are disabled and the block streams at wire speed. On v2 every
+ * store writes directly to flash/eeprom and is acknowledged; flash is written
+ * in words, missing bytes of the first/last word are padded with 0xff.
+ *
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Data space address
+ * @param length Length of data block (1..256)
+ * @param words Store words instead of bytes
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_writeBurst(uint32_t mempointer, uint32_t address, uint16_t length, uint8_t words) {
+
+    uint8_t rsd = (updi_nvmversion == 0);
+    uint32_t start = address;
+    uint32_t end = address + length;
+
+    if (words) {
+        start &= ~1UL;
+        end = (end + 1) & ~1UL;
+    }
+
+    if (!updi_setPointer(start)) return 0;
+    if (rsd && !updi_stcs(UPDI_CS_CTRLA, UPDI_CTRLA_IBDLY | UPDI_CTRLA_RSD)) return 0;
+    if (!updi_repeat(words ? (end - start) / 2 : length)) return 0;
+    if (!updi_send(UPDI_SYNCH) || !updi_send(UPDI_ST | UPDI_PTR_INC | (words ? UPDI_DATA_16 : UPDI_DATA_8))) return 0;
+
+    for (; start < end; start++) {
+
+        uint8_t data = 0xff;
+        if ((start >= address) && (start < address + length)) data = flash_readbyte(mempointer++);
+
+        if (!updi_send(data)) return 0;
+        if (!rsd && (!words || (start & 1)) && !updi_receiveAck()) return 0;
+    }
+
+    if (rsd && !updi_stcs(UPDI_CS_CTRLA, UPDI_CTRLA_IBDLY)) return 0;
+
+    return 1;
+}
+
+/**
+ * @brief Transfer given memory block to UPDI target
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Data space address
+ * @param length Length of data block
+ * @param pagesize Size of target page
+ * @param cmd NVM command to write page buffer (v0) or to enable writing (v2)
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+static uint8_t updi_write(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize, uint8_t cmd) {
+
+    // one burst per page, REPEAT is limited to 256 bytes (and up to 256 words)
+    if ((pagesize == 0) || (pagesize > 256)) pagesize = 256;
+
+    if (updi_nvmversion == 2) {
+        if (!updi_waitNVM() || !updi_nvmCommand(cmd)) return 0;
+    }
+
+    while (length > 0) {
+
+        uint16_t chunk = pagesize - isp_pageOffset(address, pagesize);
+        if (chunk > length) chunk = length;
+
+        if (!updi_waitNVM()) return 0;
+        if ((updi_nvmversion == 0) && !updi_nvmCommand(UPDI_NVM0_CMD_PBC)) return 0;
+        if (!updi_writeBurst(mempointer, address, chunk, (updi_nvmversion == 2) && (cmd == UPDI_NVM2_CMD_FLWR))) return 0;
+        if ((updi_nvmversion == 0) && !updi_nvmCommand(cmd)) return 0;
+
+        mempointer += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+
+    if (!updi_waitNVM()) return 0;
+    if (updi_nvmversion == 2) return updi_nvmCommand(UPDI_NVM2_CMD_NOCMD);
+
+    return 1;
+}
+
+/**
+ * @brief Read data from UPDI target and verify its content with given block
+ * @param mempointer Pointer to data block to verify with
+ * @param address Data space address
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+static uint8_t updi_verify(uint32_t mempointer, uint32_t address, uint32_t length) {
+
+    uint8_t success = 1;
+
+    while (length > 0) {
+
+        uint16_t chunk = 256;
+        uint16_t i;
+        if (chunk > length) chunk = length;
+
+        if (!updi_setPointer(address) || !updi_repeat(chunk)) return 0;
+        if (!updi_send(UPDI_SYNCH) || !updi_send(UPDI_LD | UPDI_PTR_INC | UPDI_DATA_8)) return 0;
+
+        // read complete burst even after mismatch to stay in sync
+        for (i = 0; i < chunk; i++) {
+            uint8_t data;
+            if (!updi_receive(&data)) return 0;
+            if (data != flash_readbyte(mempointer++)) success = 0;
+        }
+
+        if (!success) return 0;
+
+        address += chunk;
+        length -= chunk;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Transfer given memory block to UPDI target flash
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Target flash address
+ * @param length Length of data block
+ * @param pagesize Size of target flash page
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+uint8_t updi_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+    return updi_requireProgmode() && updi_write(mempointer, updi_flashstart + address, length, pagesize,
+            (updi_nvmversion == 0) ? UPDI_NVM0_CMD_WP : UPDI_NVM2_CMD_FLWR);
+}
+
+/**
+ * @brief Read data from UPDI target and verify its content with given flash block
+ * @param mempointer Pointer to data block to verify with
+ * @param address Target flash address
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+uint8_t updi_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length) {
+    return updi_requireProgmode() && updi_verify(mempointer, updi_flashstart + address, length);
+}
+
+/**
+ * @brief Transfer given memory block to UPDI target eeprom
+ * @param mempointer Pointer to start of data to transfer
+ * @param address Target eeprom address
+ * @param length Length of data block
+ * @param pagesize Size of target eeprom page
+ * @retval 0 Error occured
+ * @retval 1 Everything okay
+ */
+uint8_t updi_writeEEPROM(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize) {
+    return updi_requireProgmode() && updi_write(mempointer, UPDI_EEPROM_START + address, length, pagesize,
+            (updi_nvmversion == 0) ? UPDI_NVM0_CMD_ERWP : UPDI_NVM2_CMD_EEERWR);
+}
+
+/**
+ * @brief Read data from UPDI target and verify its content with given eeprom block
+ * @param mempointer Pointer to data block to verify with
+ * @param address Target eeprom address
+ * @param length Length of data block to verify
+ * @retval 0 Verification error
+ * @retval 1 Verification successful
+ */
+uint8_t updi_verifyEEPROM(uint32_t mempointer, uint32_t address, uint32_t length) {
+    return updi_requireProgmode() && updi_verify(mempointer, UPDI_EEPROM_START + address, length);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file updi.h
+ *
+ * @brief This file contains definitions for UPDI programming functions
+ *
+ * @author agent
+ * @copyright (c) 2026 agent
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef _UPDI_
+#define _UPDI_
+
+#define UPDI_SYNCH 0x55
+#define UPDI_ACK 0x40
+
+#define UPDI_LDS 0x00
+#define UPDI_STS 0x40
+#define UPDI_LD 0x20
+#define UPDI_ST 0x60
+#define UPDI_LDCS 0x80
+#define UPDI_STCS 0xC0
+#define UPDI_REPEAT 0xA0
+#define UPDI_KEY 0xE0
+
+#define UPDI_PTR 0x00
+#define UPDI_PTR_INC 0x04
+#define UPDI_PTR_ADDRESS 0x08
+
+#define UPDI_ADDRESS_16 0x04
+#define UPDI_ADDRESS_24 0x08
+#define UPDI_DATA_8 0x00
+#define UPDI_DATA_16 0x01
+#define UPDI_DATA_24 0x02
+
+#define UPDI_KEY_64 0x00
+#define UPDI_KEY_SIB 0x05
+#define UPDI_SIB_LENGTH 16
+
+#define UPDI_CS_STATUSA 0x00
+#define UPDI_CS_CTRLA 0x02
+#define UPDI_CS_CTRLB 0x03
+#define UPDI_ASI_KEY_STATUS 0x07
+#define UPDI_ASI_RESET_REQ 0x08
+#define UPDI_ASI_CTRLA 0x09
+#define UPDI_ASI_SYS_STATUS 0x0B
+
+#define UPDI_CTRLA_IBDLY 0x80
+#define UPDI_CTRLA_RSD 0x08
+#define UPDI_CTRLB_CCDETDIS 0x08
+#define UPDI_CTRLB_UPDIDIS 0x04
+#define UPDI_KEY_STATUS_CHIPERASE 0x08
+#define UPDI_KEY_STATUS_NVMPROG 0x10
+#define UPDI_SYS_STATUS_LOCKSTATUS 0x01
+#define UPDI_SYS_STATUS_NVMPROG 0x08
+#define UPDI_RESET_REQ_VALUE 0x59
+#define UPDI_ASI_CTRLA_CLK16M 0x01
+
+#define UPDI_NVMCTRL_CTRLA 0x1000
+#define UPDI_NVMCTRL_STATUS 0x1002
+#define UPDI_NVMCTRL_STATUS_BUSY 0x03
+
+#define UPDI_NVM0_CMD_WP 0x01       ///< NVMCTRL v0: Write page
+#define UPDI_NVM0_CMD_ERWP 0x03     ///< NVMCTRL v0: Erase and write page
+#define UPDI_NVM0_CMD_PBC 0x04      ///< NVMCTRL v0: Page buffer clear
+#define UPDI_NVM2_CMD_NOCMD 0x00    ///< NVMCTRL v2: No command
+#define UPDI_NVM2_CMD_FLWR 0x02     ///< NVMCTRL v2: Flash write enable
+#define UPDI_NVM2_CMD_EEERWR 0x13   ///< NVMCTRL v2: EEPROM erase/write enable
+
+#define UPDI_EEPROM_START 0x1400
+
+// 8 MHz, double speed: baud = 1 MHz / (UBRR + 1)
+#define UPDI_UBRR_INIT 7            ///< 125 kBaud with default UPDI clock
+#define UPDI_UBRR_FAST 1            ///< 500 kBaud with 16 MHz UPDI clock
+
+#define UPDI_TIMEOUT CLOCK_TICKER_FAST_10MS
+
+uint8_t updi_connect();
+uint8_t updi_disconnect();
+uint8_t updi_erase();
+uint8_t updi_writeFlash(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize);
+uint8_t updi_verifyFlash(uint32_t mempointer, uint32_t address, uint32_t length);
+uint8_t updi_writeEEPROM(uint32_t mempointer, uint32_t address, uint32_t length, uint16_t pagesize);
+uint8_t updi_verifyEEPROM(uint32_t mempointer, uint32_t address, uint32_t length);
+
+#endif